@@ -73,6 +73,8 @@ extern const char *H2_MAGIC_TOKEN;
 #define H2_MAX_PADLEN               256
 /* Initial default window size, RFC 7540 ch. 6.5.2 */
 #define H2_INITIAL_WINDOW_SIZE      ((64*1024)-1)
+/* Initial HPACK dynamic table size, RFC 7540 ch. 6.5.2 */
+#define H2_INITIAL_HEADER_TABLE_SIZE    4096
 
 #define H2_STREAM_CLIENT_INITIATED(id)      (id&0x01)
 
@@ -139,6 +141,7 @@ typedef enum {
     H2_SEV_IN_ERROR,
     H2_SEV_IN_DATA_PENDING,
     H2_SEV_OUT_C1_BLOCK,
+    H2_SEV_OUT_C1_SOCK_BLOCK,
 } h2_stream_event_t;
 
 
@@ -156,6 +159,7 @@ struct h2_request {
 
     apr_time_t request_time;
     unsigned int chunked : 1;   /* iff request body needs to be forwarded as chunked */
+    unsigned int early_hints_sent : 1; /* iff c1 already answered with a 103 */
     apr_off_t raw_bytes;        /* RAW network bytes that generated this request - if known. */
     int http_status;            /* Store a possible HTTP status code that gets
                                  * defined before creating the dummy HTTP/1.1
@@ -176,6 +180,8 @@ struct h2_headers {
     apr_table_t *headers;
     apr_table_t *notes;
     apr_off_t   raw_bytes;      /* RAW network bytes that generated this request - if known. */
+    struct h2_ngheader *ngh;    /* the fields in HTTP/2 form, once made. Headers
+                                 * beamed to c1 have only these, not the table. */
 };
 
 typedef apr_status_t h2_io_data_cb(void *ctx, const char *data, apr_off_t len);
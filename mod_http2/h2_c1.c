@@ -41,6 +41,7 @@
 #include "h2_session.h"
 #include "h2_stream.h"
 #include "h2_protocol.h"
+#include "h2_push.h"
 #include "h2_workers.h"
 #include "h2_c1.h"
 #include "h2_version.h"
@@ -49,6 +50,7 @@
 static struct h2_workers *workers;
 
 static int async_mpm;
+static int mpm_can_poll;
 
 APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_in) *h2_c_logio_add_bytes_in;
 APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_out) *h2_c_logio_add_bytes_out;
@@ -68,6 +70,11 @@ apr_status_t h2_c1_child_init(apr_pool_t *pool, server_rec *s)
         async_mpm = 0;
         status = APR_SUCCESS;
     }
+#ifdef AP_MPMQ_CAN_POLL
+    if (async_mpm && ap_mpm_query(AP_MPMQ_CAN_POLL, &mpm_can_poll)) {
+        mpm_can_poll = 0;
+    }
+#endif
 
     h2_config_init(pool);
 
@@ -81,6 +88,26 @@ apr_status_t h2_c1_child_init(apr_pool_t *pool, server_rec *s)
     h2_c_logio_add_bytes_in = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_in);
     h2_c_logio_add_bytes_out = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_out);
 
+    status = h2_c1_io_child_init(pool, s);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+    status = h2_session_child_init(pool, s);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+    status = h2_push_learn_child_init(pool, s);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+    status = h2_stream_child_init(pool, s);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+    status = h2_push_links_child_init(pool, s);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
     return h2_mplx_c1_child_init(pool, s);
 }
 
@@ -111,6 +138,7 @@ apr_status_t h2_c1_setup(conn_rec *c, request_rec *r, server_rec *s)
     ctx = h2_conn_ctx_get(c);
     ap_assert(ctx);
     ctx->session = session;
+    session->suspendable = (mpm_can_poll && c->cs);
     /* remove the input filter of mod_reqtimeout, now that the connection
      * is established and we have switched to h2. reqtimeout has supervised
      * possibly configured handshake timeouts and needs to get out of the way
@@ -121,10 +149,89 @@ cleanup:
     return rv;
 }
 
+#ifdef AP_MPMQ_CAN_POLL
+typedef struct {
+    conn_rec *c;
+    apr_pool_t *pool;
+} c1_suspend_ctx;
+
+static void c1_resumed(c1_suspend_ctx *sctx, int timed_out)
+{
+    conn_rec *c = sctx->c;
+    h2_conn_ctx_t *conn_ctx = h2_conn_ctx_get(c);
+
+    /* the MPM no longer polls the descriptors we gave it */
+    apr_pool_destroy(sctx->pool);
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, c,
+                  H2_SSSN_MSG(conn_ctx->session, "resumed, timed_out=%d"),
+                  timed_out);
+    if (timed_out) {
+        h2_session_event(conn_ctx->session, H2_SESSION_EV_CONN_TIMEOUT,
+                         APR_TIMEUP, "timeout");
+    }
+    h2_c1_run(c);
+    if (c->cs->state != CONN_STATE_SUSPENDED) {
+        /* hand the connection back, the MPM takes it into write
+         * completion and closes it from there when we are done. */
+        if (c->cs->state == CONN_STATE_LINGER) {
+            c->keepalive = AP_CONN_CLOSE;
+        }
+        ap_mpm_resume_suspended(c);
+    }
+}
+
+static void c1_resume(void *baton)
+{
+    c1_resumed(baton, 0);
+}
+
+static void c1_resume_timeout(void *baton)
+{
+    c1_resumed(baton, 1);
+}
+
+/**
+ * Give the c1 socket and the pipes of all active streams to the
+ * MPM for polling and suspend the connection. One of the callbacks
+ * resumes processing in an MPM worker thread when any of them
+ * becomes readable or the connection Timeout passes.
+ */
+static apr_status_t c1_suspend(conn_rec *c, h2_session *session)
+{
+    c1_suspend_ctx *sctx;
+    apr_array_header_t *pfds;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    rv = apr_pool_create(&pool, session->pool);
+    if (APR_SUCCESS != rv) return rv;
+    apr_pool_tag(pool, "h2_c1_suspend");
+    rv = h2_mplx_c1_suspend_pfds(session->mplx, pool, &pfds);
+    if (APR_SUCCESS != rv) goto cleanup;
+
+    sctx = apr_pcalloc(pool, sizeof(*sctx));
+    sctx->c = c;
+    sctx->pool = pool;
+    c->cs->state = CONN_STATE_SUSPENDED;
+    rv = ap_mpm_register_poll_callback_timeout(pool, pfds, c1_resume,
+                                               c1_resume_timeout, sctx,
+                                               session->s->timeout);
+    if (APR_SUCCESS != rv) {
+        c->cs->state = CONN_STATE_HANDLER;
+    }
+
+cleanup:
+    if (APR_SUCCESS != rv) {
+        apr_pool_destroy(pool);
+    }
+    return rv;
+}
+#endif /* AP_MPMQ_CAN_POLL */
+
 apr_status_t h2_c1_run(conn_rec *c)
 {
     apr_status_t status;
-    int mpm_state = 0;
+    int mpm_state = 0, again;
     h2_conn_ctx_t *conn_ctx = h2_conn_ctx_get(c);
     
     ap_assert(conn_ctx);
@@ -135,7 +242,26 @@ apr_status_t h2_c1_run(conn_rec *c)
             c->cs->state = CONN_STATE_HANDLER;
         }
     
+        again = 0;
         status = h2_session_process(conn_ctx->session, async_mpm);
+
+#ifdef AP_MPMQ_CAN_POLL
+        if (conn_ctx->session->suspended) {
+            status = c1_suspend(c, conn_ctx->session);
+            if (APR_SUCCESS == status) {
+                return APR_SUCCESS;
+            }
+            if (!APR_STATUS_IS_EAGAIN(status)) {
+                ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, c,
+                              H2_SSSN_LOG(APLOGNO(10315), conn_ctx->session,
+                              "suspend failed, no longer trying"));
+                conn_ctx->session->suspendable = 0;
+            }
+            /* keep on processing ourself */
+            status = APR_SUCCESS;
+            again = 1;
+        }
+#endif
         
         if (APR_STATUS_IS_EOF(status)) {
             ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, c, 
@@ -150,7 +276,7 @@ apr_status_t h2_c1_run(conn_rec *c)
         if (ap_mpm_query(AP_MPMQ_MPM_STATE, &mpm_state)) {
             break;
         }
-    } while (!async_mpm
+    } while ((!async_mpm || again)
              && c->keepalive == AP_CONN_KEEPALIVE 
              && mpm_state != AP_MPMQ_STOPPING);
 
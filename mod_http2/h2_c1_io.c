@@ -15,7 +15,10 @@
  */
  
 #include <assert.h>
+#include <stdlib.h>
+#include <apr_atomic.h>
 #include <apr_strings.h>
+#include <apr_portable.h>
 #include <ap_mpm.h>
 #include <mpm_common.h>
 
@@ -36,6 +39,19 @@
 #include "h2_session.h"
 #include "h2_util.h"
 
+#if defined(__linux__) && APR_HAVE_NETINET_TCP_H
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#ifdef TCP_INFO
+#define H2_C1_TCP_INFO 1
+#endif
+#if defined(TCP_NOTSENT_LOWAT) && (defined(SIOCOUTQNSD) || defined(SIOCOUTQ))
+#define H2_C1_NOTSENT_LOWAT 1
+#endif
+#endif
+
 #define TLS_DATA_MAX          (16*1024) 
 
 /* Calculated like this: assuming MTU 1500 bytes
@@ -56,6 +72,20 @@
  */
 #define WRITE_SIZE_MAX        (TLS_DATA_MAX) 
 
+/* Scratch buffers for TLS records are taken from a per child slab
+ * of that many WRITE_SIZE_MAX buffers. The slab is allocated when the
+ * first buffer is needed and never grown, when all buffers are in use,
+ * we allocate from the connection. */
+#define SLAB_SLOTS            256
+#define SLAB_WORDS            (SLAB_SLOTS / 32)
+
+/* Size of the buffer for frame headers and other small frame data
+ * on unbuffered connections. Larger frames are written as before. */
+#define HBUF_SIZE             (8*1024)
+
+/* The maximum number of iovecs we hand to a single socket write. */
+#define IOV_MAX_PER_WRITE     64
+
 #define BUF_REMAIN            ((apr_size_t)(bmax-off))
 
 static void h2_c1_io_bb_log(conn_rec *c, int stream_id, int level,
@@ -138,6 +168,164 @@ static void h2_c1_io_bb_log(conn_rec *c, int stream_id, int level,
     }
 
 
+/* Written once by the first thread needing a buffer, all access
+ * goes through the atomics for the memory barriers. */
+static volatile void *slab_base;
+static volatile apr_uint32_t slab_failed;
+static volatile apr_uint32_t slab_used[SLAB_WORDS];
+
+static char *slab_read(void)
+{
+    /* a cas that never swaps, to read the pointer with a barrier */
+    return apr_atomic_casptr(&slab_base, NULL, NULL);
+}
+
+static apr_status_t slab_cleanup(void *data)
+{
+    (void)data;
+    free(apr_atomic_xchgptr(&slab_base, NULL));
+    return APR_SUCCESS;
+}
+
+apr_status_t h2_c1_io_child_init(apr_pool_t *pool, server_rec *s)
+{
+    (void)s;
+    /* Children that never write TLS records on a h2 connection
+     * do not need the slab, it is allocated on first use. */
+    apr_pool_cleanup_register(pool, NULL, slab_cleanup, apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+static char *slab_assure(void)
+{
+    char *base = slab_read(), *nbase;
+
+    if (!base && !apr_atomic_read32(&slab_failed)) {
+        nbase = malloc((apr_size_t)SLAB_SLOTS * WRITE_SIZE_MAX);
+        if (!nbase) {
+            apr_atomic_set32(&slab_failed, 1);
+            return NULL;
+        }
+        base = apr_atomic_casptr(&slab_base, nbase, NULL);
+        if (base) {
+            /* another thread was faster */
+            free(nbase);
+        }
+        else {
+            base = nbase;
+        }
+    }
+    return base;
+}
+
+static char *slab_get(void)
+{
+    apr_uint32_t used, bit;
+    char *base;
+    int i, n;
+
+    if (!(base = slab_assure())) {
+        return NULL;
+    }
+    for (i = 0; i < SLAB_WORDS; ++i) {
+        for (;;) {
+            used = apr_atomic_read32(&slab_used[i]);
+            if (used == 0xffffffffu) {
+                break;
+            }
+            n = 0;
+            bit = 1;
+            while (used & bit) {
+                ++n;
+                bit <<= 1;
+            }
+            if (apr_atomic_cas32(&slab_used[i], used | bit, used) == used) {
+                return base + ((apr_size_t)(i * 32 + n) * WRITE_SIZE_MAX);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* free function for scratch buffers, they either come from the
+ * slab or from the connection bucket allocator. */
+static void scratch_free(void *data)
+{
+    const char *p = data, *base = slab_read();
+
+    if (base && p >= base
+        && p < base + ((apr_size_t)SLAB_SLOTS * WRITE_SIZE_MAX)) {
+        apr_size_t slot = (apr_size_t)(p - base) / WRITE_SIZE_MAX;
+        apr_uint32_t used, bit = (1u << (slot % 32));
+
+        do {
+            used = apr_atomic_read32(&slab_used[slot / 32]);
+        } while (apr_atomic_cas32(&slab_used[slot / 32], used & ~bit, used) != used);
+    }
+    else {
+        apr_bucket_free(data);
+    }
+}
+
+static apr_status_t c1_io_cleanup(void *data)
+{
+    h2_c1_io *io = data;
+
+    if (io->scratch) {
+        /* never handed to a bucket, give it back */
+        scratch_free(io->scratch);
+        io->scratch = NULL;
+        io->slen = io->ssize = 0;
+    }
+    return APR_SUCCESS;
+}
+
+#ifdef H2_C1_NOTSENT_LOWAT
+static apr_status_t set_notsent_lowat(h2_c1_io *io, int lowat)
+{
+    conn_rec *c = io->session->c1;
+    apr_os_sock_t fd;
+    apr_status_t rv;
+
+    rv = apr_os_sock_get(&fd, ap_get_conn_socket(c));
+    if (APR_SUCCESS == rv
+        && setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+                      &lowat, sizeof(lowat)) < 0) {
+        rv = apr_get_netos_error();
+    }
+    if (APR_SUCCESS != rv) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, rv, c, APLOGNO(10314)
+                      "h2_c1_io(%ld): unable to set TCP_NOTSENT_LOWAT",
+                      c->id);
+    }
+    return rv;
+}
+
+/**
+ * Get the number of bytes in the socket send queue that have not
+ * been sent yet. Where the kernel cannot tell sent from unsent,
+ * this includes data that is not yet acknowledged.
+ */
+static apr_status_t get_notsent(h2_c1_io *io, apr_size_t *pnotsent)
+{
+    apr_os_sock_t fd;
+    apr_status_t rv;
+    int n = 0;
+
+    rv = apr_os_sock_get(&fd, ap_get_conn_socket(io->session->c1));
+    if (APR_SUCCESS != rv) return rv;
+#ifdef SIOCOUTQNSD
+    if (ioctl(fd, SIOCOUTQNSD, &n) < 0) {
+#else
+    if (ioctl(fd, SIOCOUTQ, &n) < 0) {
+#endif
+        return apr_get_netos_error();
+    }
+    *pnotsent = (n > 0)? (apr_size_t)n : 0;
+    return APR_SUCCESS;
+}
+#endif /* H2_C1_NOTSENT_LOWAT */
+
 apr_status_t h2_c1_io_init(h2_c1_io *io, h2_session *session)
 {
     conn_rec *c = session->c1;
@@ -147,6 +335,7 @@ apr_status_t h2_c1_io_init(h2_c1_io *io, h2_session *session)
     io->is_tls = ap_ssl_conn_is_ssl(session->c1);
     io->buffer_output  = io->is_tls;
     io->flush_threshold = 4 * (apr_size_t)h2_config_sgeti64(session->s, H2_CONF_STREAM_MAX_MEM);
+    io->flush_delay = h2_config_sgeti64(session->s, H2_CONF_OUTPUT_FLUSH_DELAY);
 
     if (io->buffer_output) {
         /* This is what we start with, 
@@ -155,15 +344,30 @@ apr_status_t h2_c1_io_init(h2_c1_io *io, h2_session *session)
         io->warmup_size = h2_config_sgeti64(session->s, H2_CONF_TLS_WARMUP_SIZE);
         io->cooldown_usecs = (h2_config_sgeti(session->s, H2_CONF_TLS_COOLDOWN_SECS)
                               * APR_USEC_PER_SEC);
-        io->cooldown_usecs = 0;
         io->write_size = (io->cooldown_usecs > 0?
                           WRITE_SIZE_INITIAL : WRITE_SIZE_MAX);
+        io->last_write = apr_time_now();
+        apr_pool_cleanup_register(session->pool, io, c1_io_cleanup,
+                                  apr_pool_cleanup_null);
     }
     else {
         io->warmup_size = 0;
         io->cooldown_usecs = 0;
         io->write_size = 0;
+        io->hbuf_size = HBUF_SIZE;
+        io->hbuf = apr_palloc(c->pool, io->hbuf_size);
+    }
+
+#ifdef H2_C1_NOTSENT_LOWAT
+    {
+        int lowat = h2_config_sgeti(session->s, H2_CONF_TCP_NOTSENT_LOWAT);
+        /* Only use it when the socket honors it. Otherwise, the socket
+         * reports writable while we consider it full and we would spin. */
+        if (lowat > 0 && APR_SUCCESS == set_notsent_lowat(io, lowat)) {
+            io->notsent_lowat = (apr_size_t)lowat;
+        }
     }
+#endif
 
     if (APLOGctrace1(c)) {
         ap_log_cerror(APLOG_MARK, APLOG_TRACE4, 0, c,
@@ -176,14 +380,103 @@ apr_status_t h2_c1_io_init(h2_c1_io *io, h2_session *session)
     return APR_SUCCESS;
 }
 
+#ifdef H2_C1_TCP_INFO
+/**
+ * Get the number of bytes TCP may currently send without waiting
+ * for acknowledgements, e.g. the free part of the congestion window.
+ */
+static apr_status_t get_send_room(h2_c1_io *io, apr_size_t *proom)
+{
+    conn_rec *c = io->session->c1;
+    apr_os_sock_t fd;
+    struct tcp_info ti;
+    socklen_t tlen = sizeof(ti);
+    apr_status_t rv;
+
+    rv = apr_os_sock_get(&fd, ap_get_conn_socket(c));
+    if (APR_SUCCESS != rv) return rv;
+    memset(&ti, 0, sizeof(ti));
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &tlen) < 0) {
+        return apr_get_netos_error();
+    }
+    io->rtt_usecs = ti.tcpi_rtt;
+    io->rto_usecs = ti.tcpi_rto;
+    *proom = (ti.tcpi_snd_cwnd > ti.tcpi_unacked)?
+             (apr_size_t)(ti.tcpi_snd_cwnd - ti.tcpi_unacked) * ti.tcpi_snd_mss : 0;
+    return APR_SUCCESS;
+}
+#endif /* H2_C1_TCP_INFO */
+
+static void set_write_size(h2_c1_io *io, apr_size_t write_size)
+{
+    if (write_size != io->write_size) {
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, io->session->c1,
+                      "h2_c1_io(%ld): write size %ld -> %ld, rtt=%ldus",
+                      io->session->c1->id, (long)io->write_size,
+                      (long)write_size, (long)io->rtt_usecs);
+        io->write_size = write_size;
+    }
+}
+
+/**
+ * Called before we start a new TLS record. After the connection was
+ * idle, the peer's congestion window is likely small again and
+ * records larger than what arrives in one round trip delay the
+ * first bytes the client can decrypt. Go back to small records then.
+ */
+static void check_cooldown(h2_c1_io *io)
+{
+    apr_time_t idle;
+
+    if (io->cooldown_usecs <= 0 || io->write_size <= WRITE_SIZE_INITIAL) {
+        return;
+    }
+    idle = apr_time_now() - io->last_write;
+    if (idle >= io->cooldown_usecs
+        || (io->rto_usecs > 0 && idle >= io->rto_usecs)) {
+        /* long time not written, reset write size */
+        set_write_size(io, WRITE_SIZE_INITIAL);
+        io->bytes_written = 0;
+    }
+}
+
+/**
+ * Called after output has been passed on. Grows the record size while
+ * the connection is busy, as far as TCP's send window allows.
+ */
+static void check_warmup(h2_c1_io *io)
+{
+    io->last_write = apr_time_now();
+    if (io->write_size >= WRITE_SIZE_MAX || io->cooldown_usecs <= 0) {
+        return;
+    }
+#ifdef H2_C1_TCP_INFO
+    {
+        apr_size_t room;
+        if (APR_SUCCESS == get_send_room(io, &room)) {
+            /* records that fit into the send window can be decrypted
+             * by the client after a single round trip */
+            set_write_size(io, H2MAX(WRITE_SIZE_INITIAL,
+                                     H2MIN(room, WRITE_SIZE_MAX)));
+            return;
+        }
+    }
+#endif
+    if (io->bytes_written >= io->warmup_size) {
+        /* connection is hot, use max size */
+        set_write_size(io, WRITE_SIZE_MAX);
+    }
+}
+
 static void append_scratch(h2_c1_io *io)
 {
     if (io->scratch && io->slen > 0) {
         apr_bucket *b = apr_bucket_heap_create(io->scratch, io->slen,
-                                               apr_bucket_free,
+                                               scratch_free,
                                                io->session->c1->bucket_alloc);
         APR_BRIGADE_INSERT_TAIL(io->output, b);
         io->buffered_len += io->slen;
+        ++io->records;
         io->scratch = NULL;
         io->slen = io->ssize = 0;
     }
@@ -195,9 +488,13 @@ static apr_size_t assure_scratch_space(h2_c1_io *io) {
         append_scratch(io);
     }
     if (!io->scratch) {
-        /* we control the size and it is larger than what buckets usually
-         * allocate. */
-        io->scratch = apr_bucket_alloc(io->write_size, io->session->c1->bucket_alloc);
+        check_cooldown(io);
+        io->scratch = (io->write_size <= WRITE_SIZE_MAX)? slab_get() : NULL;
+        if (!io->scratch) {
+            /* we control the size and it is larger than what buckets usually
+             * allocate. */
+            io->scratch = apr_bucket_alloc(io->write_size, io->session->c1->bucket_alloc);
+        }
         io->ssize = io->write_size;
         io->slen = 0;
         remain = io->ssize;
@@ -257,13 +554,126 @@ static apr_status_t read_to_scratch(h2_c1_io *io, apr_bucket *b)
     return status;
 }
 
-static apr_status_t pass_output(h2_c1_io *io, int flush)
+static int is_iov_bucket(apr_bucket *b)
+{
+    return APR_BUCKET_IS_HEAP(b)
+        || APR_BUCKET_IS_TRANSIENT(b)
+        || APR_BUCKET_IS_IMMORTAL(b)
+        || APR_BUCKET_IS_POOL(b)
+#if APR_HAS_MMAP
+        || APR_BUCKET_IS_MMAP(b)
+#endif
+        ;
+}
+
+static int is_iov_meta(apr_bucket *b)
+{
+    return APR_BUCKET_IS_FLUSH(b) || H2_BUCKET_IS_H2EOS(b);
+}
+
+static int can_write_direct(h2_c1_io *io)
 {
     conn_rec *c = io->session->c1;
-    apr_off_t bblen;
-    apr_status_t rv;
+    /* We may only bypass the filter chain when nothing but the
+     * network filter is installed and it does not hold any data
+     * from a previous pass. */
+    return !io->buffer_output && !io->unflushed && !c->aborted
+        && c->output_filters
+        && c->output_filters->frec->ftype == AP_FTYPE_NETWORK;
+}
+
+/**
+ * Write the memory buckets at the start of io->output with as few
+ * socket writes as possible. Written buckets are removed, the
+ * remainder stays in io->output for the filter chain to handle.
+ */
+static apr_status_t write_direct(h2_c1_io *io, apr_off_t *pwritten)
+{
+    conn_rec *c = io->session->c1;
+    apr_socket_t *sock = ap_get_conn_socket(c);
+    struct iovec vec[IOV_MAX_PER_WRITE];
+    apr_bucket *b, *next;
+    const char *data;
+    apr_size_t len, written;
+    int nvec;
+    apr_status_t rv = APR_SUCCESS;
+
+    *pwritten = 0;
+    while (!APR_BRIGADE_EMPTY(io->output)) {
+        nvec = 0;
+        for (b = APR_BRIGADE_FIRST(io->output);
+             b != APR_BRIGADE_SENTINEL(io->output) && nvec < IOV_MAX_PER_WRITE;
+             b = APR_BUCKET_NEXT(b)) {
+            if (APR_BUCKET_IS_METADATA(b)) {
+                if (!is_iov_meta(b)) break;
+                continue;
+            }
+            if (!is_iov_bucket(b)) break;
+            if (b->length == 0) continue;
+            rv = apr_bucket_read(b, &data, &len, APR_NONBLOCK_READ);
+            if (APR_SUCCESS != rv) goto cleanup;
+            vec[nvec].iov_base = (void *)data;
+            vec[nvec].iov_len = len;
+            ++nvec;
+        }
+        if (nvec == 0) {
+            if (b == APR_BRIGADE_SENTINEL(io->output)) {
+                /* only FLUSH/h2eos left, everything has been written */
+                apr_brigade_cleanup(io->output);
+            }
+            break;
+        }
+
+        written = 0;
+        rv = apr_socket_sendv(sock, vec, nvec, &written);
+        ++io->writev_calls;
+        io->writev_iovecs += nvec;
+        *pwritten += (apr_off_t)written;
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE2, rv, c,
+                      "h2_c1_io(%ld): writev %d iovecs, %ld bytes",
+                      c->id, nvec, (long)written);
+
+        /* remove what has been written, including metadata in between */
+        for (b = APR_BRIGADE_FIRST(io->output);
+             b != APR_BRIGADE_SENTINEL(io->output);
+             b = next) {
+            next = APR_BUCKET_NEXT(b);
+            if (APR_BUCKET_IS_METADATA(b)) {
+                if (!is_iov_meta(b)) break;
+                apr_bucket_delete(b);
+            }
+            else if (b->length <= written) {
+                written -= b->length;
+                apr_bucket_delete(b);
+            }
+            else {
+                if (written > 0) {
+                    apr_bucket_split(b, written);
+                    apr_bucket_delete(b);
+                }
+                break;
+            }
+        }
+        if (APR_SUCCESS != rv) goto cleanup;
+    }
+
+cleanup:
+    if (APR_STATUS_IS_EAGAIN(rv)) {
+        /* leave the rest to the network filter */
+        rv = APR_SUCCESS;
+    }
+    return rv;
+}
+
+static apr_status_t pass_output(h2_c1_io *io, int flush, int with_scratch)
+{
+    conn_rec *c = io->session->c1;
+    apr_off_t bblen, written = 0;
+    apr_status_t rv = APR_SUCCESS;
     
-    append_scratch(io);
+    if (with_scratch) {
+        append_scratch(io);
+    }
     if (flush) {
         if (!APR_BUCKET_IS_FLUSH(APR_BRIGADE_LAST(io->output))) {
             apr_bucket *b = apr_bucket_flush_create(c->bucket_alloc);
@@ -274,32 +684,34 @@ static apr_status_t pass_output(h2_c1_io *io, int flush)
         return APR_SUCCESS;
     }
     
-    io->unflushed = !APR_BUCKET_IS_FLUSH(APR_BRIGADE_LAST(io->output));
     apr_brigade_length(io->output, 0, &bblen);
     C1_IO_BB_LOG(c, 0, APLOG_TRACE2, "out", io->output);
     
-    rv = ap_pass_brigade(c->output_filters, io->output);
-    if (APR_SUCCESS != rv) goto cleanup;
+    if (can_write_direct(io)) {
+        rv = write_direct(io, &written);
+        if (APR_SUCCESS != rv) goto cleanup;
+        if (!APR_BRIGADE_EMPTY(io->output)
+            && !APR_BUCKET_IS_FLUSH(APR_BRIGADE_LAST(io->output))) {
+            /* whatever remains goes through the filters, but we need
+             * the network to be drained before we write directly again. */
+            apr_bucket *b = apr_bucket_flush_create(c->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(io->output, b);
+        }
+    }
+
+    io->unflushed = 0;
+    if (!APR_BRIGADE_EMPTY(io->output)) {
+        io->unflushed = !APR_BUCKET_IS_FLUSH(APR_BRIGADE_LAST(io->output));
+        ++io->pass_calls;
+        rv = ap_pass_brigade(c->output_filters, io->output);
+        if (APR_SUCCESS != rv) goto cleanup;
+    }
 
     io->buffered_len = 0;
+    io->notsent_known = 0;
     io->bytes_written += (apr_size_t)bblen;
-
-    if (io->write_size < WRITE_SIZE_MAX
-         && io->bytes_written >= io->warmup_size) {
-        /* connection is hot, use max size */
-        io->write_size = WRITE_SIZE_MAX;
-    }
-    else if (io->cooldown_usecs > 0
-             && io->write_size > WRITE_SIZE_INITIAL) {
-        apr_time_t now = apr_time_now();
-        if ((now - io->last_write) >= io->cooldown_usecs) {
-            /* long time not written, reset write size */
-            io->write_size = WRITE_SIZE_INITIAL;
-            io->bytes_written = 0;
-        }
-        else {
-            io->last_write = now;
-        }
+    if (io->buffer_output) {
+        check_warmup(io);
     }
 
 cleanup:
@@ -309,6 +721,8 @@ cleanup:
                       c->id, (long)bblen);
     }
     apr_brigade_cleanup(io->output);
+    /* all transient buckets are gone, the header buffer is free again */
+    io->hbuf_len = 0;
     return rv;
 }
 
@@ -317,17 +731,86 @@ int h2_c1_io_needs_flush(h2_c1_io *io)
     return io->buffered_len >= io->flush_threshold;
 }
 
+int h2_c1_io_out_blocked(h2_c1_io *io)
+{
+#ifdef H2_C1_NOTSENT_LOWAT
+    if (io->notsent_lowat > 0) {
+        /* query the socket once per pass, stream_data_cb asks per frame */
+        if (!io->notsent_known) {
+            if (APR_SUCCESS != get_notsent(io, &io->notsent)) {
+                io->notsent = 0;
+            }
+            io->notsent_known = 1;
+        }
+        /* output we hold ourself goes to the socket with the next pass */
+        if (io->notsent + (apr_size_t)io->buffered_len >= io->notsent_lowat) {
+            io->out_blocked = 1;
+            return 1;
+        }
+    }
+#else
+    (void)io;
+#endif
+    return 0;
+}
+
+apr_status_t h2_c1_io_wait_writable(h2_c1_io *io, apr_interval_time_t timeout)
+{
+    conn_rec *c = io->session->c1;
+    apr_pollfd_t pfd;
+    apr_int32_t nfds;
+    apr_status_t rv;
+
+    io->notsent_known = 0;
+    if (h2_c1_io_pending(io)) {
+        /* get our own pending data into the socket first */
+        rv = h2_c1_io_assure_flushed(io);
+        if (APR_SUCCESS != rv) return rv;
+    }
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.p = c->pool;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLOUT|APR_POLLIN;
+    pfd.desc.s = ap_get_conn_socket(c);
+    rv = apr_poll(&pfd, 1, &nfds, timeout);
+    if (APR_SUCCESS == rv && (pfd.rtnevents & APR_POLLOUT)) {
+        io->out_blocked = 0;
+    }
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE2, rv, c,
+                  "h2_c1_io(%ld): waited for writable socket, unsent=%ld, "
+                  "events=%x", c->id, (long)io->notsent, (int)pfd.rtnevents);
+    return rv;
+}
+
 int h2_c1_io_pending(h2_c1_io *io)
 {
     return !APR_BRIGADE_EMPTY(io->output) || (io->scratch && io->slen > 0);
 }
 
+static int flush_delayed(h2_c1_io *io)
+{
+    return io->flush_delay > 0 && !io->flush_urgent;
+}
+
+static apr_off_t flush_min(h2_c1_io *io)
+{
+    /* a complete record is worth sending */
+    return io->write_size? (apr_off_t)io->write_size : WRITE_SIZE_MAX;
+}
+
 apr_status_t h2_c1_io_pass(h2_c1_io *io)
 {
     apr_status_t rv = APR_SUCCESS;
 
-    if (h2_c1_io_pending(io)) {
-        rv = pass_output(io, 0);
+    if (flush_delayed(io)) {
+        /* only pass on what makes complete records, the open
+         * scratch buffer may still get filled. */
+        if (io->buffered_len >= flush_min(io)) {
+            rv = pass_output(io, 0, 0);
+        }
+    }
+    else if (h2_c1_io_pending(io)) {
+        rv = pass_output(io, 0, 1);
     }
     return rv;
 }
@@ -337,13 +820,38 @@ apr_status_t h2_c1_io_assure_flushed(h2_c1_io *io)
     apr_status_t rv = APR_SUCCESS;
 
     if (h2_c1_io_pending(io) || io->unflushed) {
-        rv = pass_output(io, 1);
+        ++io->flush_calls;
+        rv = pass_output(io, 1, 1);
         if (APR_SUCCESS != rv) goto cleanup;
     }
 cleanup:
+    io->flush_due = 0;
+    io->flush_urgent = 0;
     return rv;
 }
 
+apr_status_t h2_c1_io_schedule_flush(h2_c1_io *io)
+{
+    apr_time_t now;
+
+    if (!h2_c1_io_pending(io) && !io->unflushed) {
+        io->flush_due = 0;
+        return APR_SUCCESS;
+    }
+    if (!flush_delayed(io)
+        || (io->buffered_len + (apr_off_t)io->slen) >= flush_min(io)) {
+        return h2_c1_io_assure_flushed(io);
+    }
+    now = apr_time_now();
+    if (!io->flush_due) {
+        io->flush_due = now + io->flush_delay;
+    }
+    else if (now >= io->flush_due) {
+        return h2_c1_io_assure_flushed(io);
+    }
+    return APR_SUCCESS;
+}
+
 apr_status_t h2_c1_io_add_data(h2_c1_io *io, const char *data, size_t length)
 {
     apr_status_t status = APR_SUCCESS;
@@ -368,6 +876,25 @@ apr_status_t h2_c1_io_add_data(h2_c1_io *io, const char *data, size_t length)
             }
         }
     }
+    else if (io->hbuf && length <= (io->hbuf_size - io->hbuf_len)) {
+        char *dest = io->hbuf + io->hbuf_len;
+        apr_bucket *b = APR_BRIGADE_EMPTY(io->output)?
+                        NULL : APR_BRIGADE_LAST(io->output);
+
+        memcpy(dest, data, length);
+        if (b && APR_BUCKET_IS_TRANSIENT(b)
+            && ((const char *)b->data + b->start + b->length) == dest) {
+            /* adjacent to what we added last, e.g. frame header + padding */
+            b->length += length;
+        }
+        else {
+            b = apr_bucket_transient_create(dest, length,
+                                            io->session->c1->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(io->output, b);
+        }
+        io->hbuf_len += length;
+        io->buffered_len += length;
+    }
     else {
         status = apr_brigade_write(io->output, NULL, NULL, data, length);
         io->buffered_len += length;
@@ -410,8 +937,9 @@ apr_status_t h2_c1_io_append(h2_c1_io *io, apr_bucket_brigade *bb)
             }
         }
         else {
-            /* no buffering, forward buckets setaside on flush */
-            apr_bucket_setaside(b, io->session->c1->pool);
+            /* no buffering, forward buckets as they are. They live until
+             * the stream's h2eos bucket behind them is passed and the
+             * network filter does its own setaside when holding data. */
             APR_BUCKET_REMOVE(b);
             APR_BRIGADE_INSERT_TAIL(io->output, b);
             io->buffered_len += b->length;
@@ -486,8 +1014,12 @@ static apr_status_t read_and_feed(h2_session *session)
     rv = ap_get_brigade(session->c1->input_filters,
                         session->bbtmp, AP_MODE_READBYTES,
                         APR_NONBLOCK_READ, bytes_requested);
+    ++session->io.read_calls;
 
-    if (APR_SUCCESS == rv) {
+    if (APR_STATUS_IS_EAGAIN(rv)) {
+        ++session->io.read_wouldblock;
+    }
+    else if (APR_SUCCESS == rv) {
         h2_util_bb_log(session->c1, session->id, APLOG_TRACE2, "c1 in", session->bbtmp);
         rv = c1_in_feed_brigade(session, session->bbtmp, &bytes_fed);
         session->io.bytes_read += bytes_fed;
@@ -37,6 +37,8 @@ typedef struct {
     
     apr_size_t write_size;
     apr_time_t last_write;
+    apr_time_t rtt_usecs;       /* last measured round trip time, if known */
+    apr_time_t rto_usecs;       /* last measured retransmit timeout, if known */
     apr_int64_t bytes_read;
     apr_int64_t bytes_written;
     
@@ -44,12 +46,39 @@ typedef struct {
     apr_off_t buffered_len;
     apr_off_t flush_threshold;
     unsigned int is_flushed : 1;
+    unsigned int flush_urgent : 1;  /* pending output must not be delayed */
+    apr_interval_time_t flush_delay;/* max time to delay a flush, 0 to disable */
+    apr_time_t flush_due;           /* when a delayed flush has to happen, or 0 */
+    apr_size_t notsent_lowat;       /* TCP_NOTSENT_LOWAT set on socket, or 0 */
+    apr_size_t notsent;             /* last seen unsent bytes in socket */
+    unsigned int notsent_known : 1; /* `notsent` is valid since last pass */
+    unsigned int out_blocked : 1;   /* streams held back for a full socket */
     
     char *scratch;
     apr_size_t ssize;
     apr_size_t slen;
+
+    /* unbuffered output: small frame data (headers, padding) is collected
+     * here and referenced by transient buckets until the next pass. */
+    char *hbuf;
+    apr_size_t hbuf_size;
+    apr_size_t hbuf_len;
+
+    apr_int64_t writev_calls;   /* number of direct socket writes */
+    apr_int64_t writev_iovecs;  /* number of iovecs in those writes */
+    apr_int64_t pass_calls;     /* number of brigades passed to the filters */
+    apr_int64_t flush_calls;    /* number of flushes done */
+    apr_int64_t records;        /* number of TLS records assembled */
+    apr_int64_t read_calls;     /* number of reads from the input filters */
+    apr_int64_t read_wouldblock;/* number of reads that found no data */
 } h2_c1_io;
 
+/**
+ * Initialize the per child resources for c1 io, e.g. the buffers
+ * we use for assembling TLS records.
+ */
+apr_status_t h2_c1_io_child_init(apr_pool_t *pool, server_rec *s);
+
 apr_status_t h2_c1_io_init(h2_c1_io *io, struct h2_session *session);
 
 /**
@@ -77,11 +106,37 @@ apr_status_t h2_c1_io_pass(h2_c1_io *io);
  */
 apr_status_t h2_c1_io_assure_flushed(h2_c1_io *io);
 
+/**
+ * Flush pending output when it is urgent, enough data has been collected
+ * or the configured flush delay has passed. Otherwise, arm the flush
+ * deadline in `flush_due` and leave the output pending.
+ * @param io the connection io
+ */
+apr_status_t h2_c1_io_schedule_flush(h2_c1_io *io);
+
 /**
  * Check if the buffered amount of data needs flushing.
  */
 int h2_c1_io_needs_flush(h2_c1_io *io);
 
+/**
+ * Check if the c1 socket has more data not yet sent than the configured
+ * TCP_NOTSENT_LOWAT. Stream data should then stay in the session until
+ * the socket can take it, so prioritization still has an effect.
+ * Always 0 when the low watermark is not in use.
+ */
+int h2_c1_io_out_blocked(h2_c1_io *io);
+
+/**
+ * Wait until the c1 socket becomes writable again after
+ * `h2_c1_io_out_blocked()` reported a full socket, the client sends
+ * something or the timeout expires. `out_blocked` is only cleared when
+ * the socket is writable, input from the client leaves it set.
+ * @param io the connection io
+ * @param timeout max time to wait
+ */
+apr_status_t h2_c1_io_wait_writable(h2_c1_io *io, apr_interval_time_t timeout);
+
 /**
  * Check if we have output pending.
  */
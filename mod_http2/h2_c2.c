@@ -44,6 +44,7 @@
 #include "h2_c2_filter.h"
 #include "h2_protocol.h"
 #include "h2_mplx.h"
+#include "h2_push.h"
 #include "h2_request.h"
 #include "h2_headers.h"
 #include "h2_session.h"
@@ -418,20 +419,25 @@ static apr_status_t beam_out(conn_rec *c2, h2_conn_ctx_t *conn_ctx, apr_bucket_b
 {
     apr_off_t written, header_len = 0;
     apr_status_t rv;
-
-    if (h2_c_logio_add_bytes_out) {
-        /* mod_logio wants to report the number of bytes  written in a
-         * response, including header and footer fields. Since h2 converts
-         * those during c1 processing into the HPACKed h2 HEADER frames,
-         * we need to give mod_logio something here and count just the
-         * raw lengths of all headers in the buckets. */
-        apr_bucket *b;
-        for (b = APR_BRIGADE_FIRST(bb);
-             b != APR_BRIGADE_SENTINEL(bb);
-             b = APR_BUCKET_NEXT(b)) {
-            if (H2_BUCKET_IS_HEADERS(b)) {
+    apr_bucket *b;
+
+    for (b = APR_BRIGADE_FIRST(bb);
+         b != APR_BRIGADE_SENTINEL(bb);
+         b = APR_BUCKET_NEXT(b)) {
+        if (H2_BUCKET_IS_HEADERS(b)) {
+            if (h2_c_logio_add_bytes_out) {
+                /* mod_logio wants to report the number of bytes  written in a
+                 * response, including header and footer fields. Since h2 converts
+                 * those during c1 processing into the HPACKed h2 HEADER frames,
+                 * we need to give mod_logio something here and count just the
+                 * raw lengths of all headers in the buckets. */
                 header_len += (apr_off_t)h2_bucket_headers_headers_length(b);
             }
+            /* Bring the fields into their HTTP/2 form while we are in c2.
+             * c1 then takes them over as they are. If that fails, they
+             * travel as table and c1 will refuse them. */
+            h2_headers_flatten(h2_bucket_headers_get(b), c2->pool,
+                               conn_ctx->mplx->ngh_cache);
         }
     }
 
@@ -642,15 +648,27 @@ static int h2_c2_hook_process(conn_rec* c)
 static void check_push(request_rec *r, const char *tag)
 {
     apr_array_header_t *push_list = h2_config_push_list(r);
+    h2_conn_ctx_t *conn_ctx = h2_conn_ctx_get(r->connection);
+    int learned = 0;
 
-    if (!r->expecting_100 && push_list && push_list->nelts > 0) {
+    if (conn_ctx->request->early_hints_sent) {
+        /* c1 already announced the resources for this vhost and
+         * location and what it learned, a second 103 adds nothing. */
+        return;
+    }
+    if (!r->expecting_100 && r->method_number == M_GET
+        && h2_config_rgeti(r, H2_CONF_EARLY_HINTS) > 0
+        && h2_config_sgeti(r->server, H2_CONF_EARLY_HINTS_LEARN) > 0) {
+        learned = h2_push_learned_links(r->headers_out, r->pool, conn_ctx->request);
+    }
+    if (!r->expecting_100 && ((push_list && push_list->nelts > 0) || learned)) {
         int i, old_status;
         const char *old_line;
 
         ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
-                      "%s, early announcing %d resources for push",
-                      tag, push_list->nelts);
-        for (i = 0; i < push_list->nelts; ++i) {
+                      "%s, early announcing %d resources for push, %d learned",
+                      tag, push_list? push_list->nelts : 0, learned);
+        for (i = 0; push_list && i < push_list->nelts; ++i) {
             h2_push_res *push = &APR_ARRAY_IDX(push_list, i, h2_push_res);
             apr_table_add(r->headers_out, "Link",
                            apr_psprintf(r->pool, "<%s>; rel=preload%s",
@@ -660,7 +678,7 @@ static void check_push(request_rec *r, const char *tag)
         old_line = r->status_line;
         r->status = 103;
         r->status_line = "103 Early Hints";
-        ap_send_interim_response(r, 1);
+        h2_c2_send_interim_response(r, 1);
         r->status = old_status;
         r->status_line = old_line;
     }
@@ -677,6 +695,12 @@ static int h2_c2_hook_post_read_request(request_rec *r)
                       conn_ctx->id, conn_ctx->stream_id);
 
         /* setup the correct filters to process the request for h2 */
+        if (conn_ctx->request->chunked) {
+            /* A body without content-length. Instead of letting HTTP_IN
+             * parse it from a simulated chunked encoding, our request
+             * filter hands the stream data over as it comes. */
+            ap_remove_input_filter_byhandle(r->input_filters, "HTTP_IN");
+        }
         ap_add_input_filter("H2_C2_REQUEST_IN", NULL, r, r->connection);
 
         /* replace the core http filter that formats response headers
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include <apr_atomic.h>
 #include <apr_date.h>
 #include <apr_lib.h>
 #include <apr_strings.h>
@@ -440,8 +441,11 @@ static apr_status_t pass_response(h2_conn_ctx_t *conn_ctx, ap_filter_t *f,
     if (response->status >= 200) {
         conn_ctx->has_final_response = 1;
     }
+    if (conn_ctx->mplx) {
+        apr_atomic_inc32(&conn_ctx->mplx->responses_h1);
+    }
     ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, parser->c,
-                  APLOGNO(03197) "h2_c2(%s): passed response %d",
+                  APLOGNO(03197) "h2_c2(%s): passed response %d, parsed from HTTP/1.1",
                   parser->id, response->status);
     return status;
 }
@@ -526,6 +530,13 @@ apr_status_t h2_c2_filter_catch_h1_out(ap_filter_t* f, apr_bucket_brigade* bb)
     H2_FILTER_LOG("c2_catch_h1_out", f->c, APLOG_TRACE2, 0, "check", bb);
 
     if (!conn_ctx->has_final_response) {
+        if (!APR_BRIGADE_EMPTY(bb) && H2_BUCKET_IS_HEADERS(APR_BRIGADE_FIRST(bb))
+            && (!parser || (parser->state == H2_RP_STATUS_LINE
+                            && (!parser->tmp || APR_BRIGADE_EMPTY(parser->tmp))))) {
+            /* A response already made as h2_headers, e.g. by
+             * h2_c2_send_interim_response(). Nothing to parse. */
+            return ap_pass_brigade(f->next, bb);
+        }
         if (!parser) {
             parser = apr_pcalloc(f->c->pool, sizeof(*parser));
             parser->id = apr_psprintf(f->c->pool, "%s-%d", conn_ctx->id, conn_ctx->stream_id);
@@ -630,6 +641,9 @@ apr_status_t h2_c2_filter_response_out(ap_filter_t *f, apr_bucket_brigade *bb)
                               "h2_c2(%s): unable to create response", conn_ctx->id);
                 return APR_ENOMEM;
             }
+            if (conn_ctx->mplx) {
+                apr_atomic_inc32(&conn_ctx->mplx->responses_native);
+            }
 
             bresp = h2_bucket_headers_create(f->c->bucket_alloc, response);
             if (body_bucket) {
@@ -667,12 +681,62 @@ apr_status_t h2_c2_filter_response_out(ap_filter_t *f, apr_bucket_brigade *bb)
     return ap_pass_brigade(f->next, bb);
 }
 
+void h2_c2_send_interim_response(request_rec *r, int send_headers)
+{
+    h2_conn_ctx_t *conn_ctx = h2_conn_ctx_get(r->connection);
+    h2_headers *response;
+    apr_table_t *headers;
+    apr_bucket_brigade *bb;
+    apr_bucket *b;
+
+    if (!conn_ctx || !conn_ctx->stream_id || conn_ctx->has_final_response
+        || !ap_is_HTTP_INFO(r->status)) {
+        /* not ours to answer natively, let the core have a go */
+        ap_send_interim_response(r, send_headers);
+        return;
+    }
+    if (r->status == HTTP_CONTINUE) {
+        if (!r->expecting_100) {
+            return;
+        }
+        r->expecting_100 = 0;
+    }
+
+    if (send_headers) {
+        /* as the core does, the headers are gone once sent */
+        headers = apr_table_copy(r->pool, r->headers_out);
+        apr_table_clear(r->headers_out);
+    }
+    else {
+        headers = apr_table_make(r->pool, 1);
+    }
+    response = h2_headers_rcreate(r, r->status, headers, r->pool);
+
+    bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    b = h2_bucket_headers_create(r->connection->bucket_alloc, response);
+    APR_BRIGADE_INSERT_TAIL(bb, b);
+    b = apr_bucket_flush_create(r->connection->bucket_alloc);
+    APR_BRIGADE_INSERT_TAIL(bb, b);
+    if (conn_ctx->mplx) {
+        apr_atomic_inc32(&conn_ctx->mplx->responses_native);
+    }
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                  "h2_c2(%s-%d): send interim response %d",
+                  conn_ctx->id, conn_ctx->stream_id, r->status);
+    ap_pass_brigade(r->connection->output_filters, bb);
+    apr_brigade_destroy(bb);
+}
+
 
 struct h2_chunk_filter_t {
     const char *id;
     int eos_chunk_added;
     apr_bucket_brigade *bbchunk;
     apr_off_t chunked_total;
+    unsigned int native : 1;    /* no HTTP_IN, body passed as is */
+    unsigned int eos : 1;       /* native body ended early */
+    apr_off_t limit;            /* LimitRequestBody, 0 for none */
+    apr_off_t body_len;         /* native body bytes read */
 };
 typedef struct h2_chunk_filter_t h2_chunk_filter_t;
 
@@ -801,6 +865,17 @@ static apr_status_t read_and_chunk(ap_filter_t *f, h2_conn_ctx_t *conn_ctx,
     return status;
 }
 
+static int has_filter_before(ap_filter_t *filters, ap_filter_t *f, 
+                             const char *name)
+{
+    for (; filters && filters != f; filters = filters->next) {
+        if (!strcasecmp(filters->frec->name, name)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 apr_status_t h2_c2_filter_request_in(ap_filter_t* f,
                                   apr_bucket_brigade* bb,
                                   ap_input_mode_t mode,
@@ -820,18 +895,47 @@ apr_status_t h2_c2_filter_request_in(ap_filter_t* f,
     if (!fctx) {
         fctx = apr_pcalloc(r->pool, sizeof(*fctx));
         fctx->id = apr_psprintf(r->pool, "%s-%d", conn_ctx->id, conn_ctx->stream_id);
+        fctx->native = (conn_ctx->request->chunked 
+                        && !has_filter_before(r->input_filters, f, "HTTP_IN"));
+        fctx->limit = ap_get_limit_req_body(r);
         f->ctx = fctx;
     }
 
     ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, f->r,
-                  "h2_c2(%s-%d): request input, exp=%d",
-                  conn_ctx->id, conn_ctx->stream_id, r->expecting_100);
-    if (!conn_ctx->request->chunked) {
+                  "h2_c2(%s-%d): request input, exp=%d, native=%d",
+                  conn_ctx->id, conn_ctx->stream_id, r->expecting_100,
+                  fctx->native);
+    if (fctx->native && (fctx->eos || r->expecting_100)) {
+        /* What HTTP_IN does before reading a body */
+        if (!fctx->eos && ap_is_HTTP_SUCCESS(r->status)) {
+            int old_status = r->status;
+            const char *old_line = r->status_line;
+            
+            r->status = HTTP_CONTINUE;
+            r->status_line = NULL;
+            h2_c2_send_interim_response(r, 1);
+            r->status = old_status;
+            r->status_line = old_line;
+            r->expecting_100 = 0;
+        }
+        else {
+            /* not going to read the body, it has ended for us */
+            fctx->eos = 1;
+            b = apr_bucket_eos_create(f->c->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(bb, b);
+            return APR_SUCCESS;
+        }
+    }
+    if (!conn_ctx->request->chunked || fctx->native) {
         status = ap_get_brigade(f->next, bb, mode, block, readbytes);
         /* pipe data through, just take care of trailers */
         for (b = APR_BRIGADE_FIRST(bb); 
              b != APR_BRIGADE_SENTINEL(bb); b = next) {
             next = APR_BUCKET_NEXT(b);
+            if (fctx->native && !APR_BUCKET_IS_METADATA(b)
+                && mode != AP_MODE_SPECULATIVE) {
+                fctx->body_len += (apr_off_t)b->length;
+            }
             if (H2_BUCKET_IS_HEADERS(b)) {
                 h2_headers *headers = h2_bucket_headers_get(b);
                 ap_assert(headers);
@@ -853,6 +957,16 @@ apr_status_t h2_c2_filter_request_in(ap_filter_t* f,
                 break;
             }
         }
+        if (fctx->limit && fctx->body_len > fctx->limit) {
+            /* HTTP_IN would check this for a chunked body */
+            ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, APLOGNO(10317)
+                          "h2_c2(%s-%d): request body of %" APR_OFF_T_FMT 
+                          " bytes is larger than the limit of %" APR_OFF_T_FMT,
+                          conn_ctx->id, conn_ctx->stream_id, 
+                          fctx->body_len, fctx->limit);
+            apr_brigade_cleanup(bb);
+            return APR_ENOSPC;
+        }
         return status;
     }
 
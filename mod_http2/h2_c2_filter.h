@@ -38,6 +38,15 @@ apr_status_t h2_c2_filter_catch_h1_out(ap_filter_t* f, apr_bucket_brigade* bb);
 
 apr_status_t h2_c2_filter_response_out(ap_filter_t *f, apr_bucket_brigade *bb);
 
+/**
+ * Send the interim response in r->status, like ap_send_interim_response(),
+ * but as a h2_headers bucket that needs no HTTP/1.1 parsing afterwards.
+ * Falls back to the core function when r is not a c2 request.
+ * @param r the request to answer
+ * @param send_headers != 0 iff r->headers_out shall be sent (and cleared)
+ */
+void h2_c2_send_interim_response(request_rec *r, int send_headers);
+
 apr_status_t h2_c2_filter_request_in(ap_filter_t* f,
                                   apr_bucket_brigade* brigade,
                                   ap_input_mode_t mode,
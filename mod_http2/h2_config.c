@@ -75,6 +75,14 @@ typedef struct h2_config {
     int padding_always;
     int output_buffered;
     apr_interval_time_t stream_timeout;/* beam timeout */
+    apr_interval_time_t output_flush_delay; /* max delay of non-urgent output flushes */
+    int tcp_notsent_lowat;           /* max unsent bytes in c1 socket, 0 to disable */
+    int ctrl_frame_rate;             /* control frames/s a session may receive */
+    int client_ctrl_frame_rate;      /* control frames/s per client address */
+    int hpack_decode_size;           /* HPACK decoder dynamic table size */
+    int hpack_encode_size;           /* max HPACK encoder dynamic table size */
+    int h2_window_size_max;          /* max stream window for auto tuning, 0 for static */
+    int early_hints_learn;           /* learn preloads per page, send them as 103 */
 } h2_config;
 
 typedef struct h2_dir_config {
@@ -110,6 +118,14 @@ static h2_config defconf = {
     1,                      /* padding always */
     1,                      /* stream output buffered */
     -1,                     /* beam timeout */
+    0,                      /* output flush delay */
+    0,                      /* TCP not sent low watermark */
+    100,                    /* control frames per second */
+    0,                      /* control frames per client per second */
+    4096,                   /* HPACK decoder table size */
+    4096,                   /* HPACK encoder table size */
+    (8 * 1024 * 1024),      /* max auto tuned stream window */
+    0,                      /* learn early hints */
 };
 
 static h2_dir_config defdconf = {
@@ -153,6 +169,14 @@ void *h2_config_create_svr(apr_pool_t *pool, server_rec *s)
     conf->padding_always       = DEF_VAL;
     conf->output_buffered      = DEF_VAL;
     conf->stream_timeout         = DEF_VAL;
+    conf->output_flush_delay   = DEF_VAL;
+    conf->tcp_notsent_lowat    = DEF_VAL;
+    conf->ctrl_frame_rate      = DEF_VAL;
+    conf->client_ctrl_frame_rate= DEF_VAL;
+    conf->hpack_decode_size    = DEF_VAL;
+    conf->hpack_encode_size    = DEF_VAL;
+    conf->h2_window_size_max   = DEF_VAL;
+    conf->early_hints_learn    = DEF_VAL;
     return conf;
 }
 
@@ -195,6 +219,14 @@ static void *h2_config_merge(apr_pool_t *pool, void *basev, void *addv)
     n->padding_bits         = H2_CONFIG_GET(add, base, padding_bits);
     n->padding_always       = H2_CONFIG_GET(add, base, padding_always);
     n->stream_timeout         = H2_CONFIG_GET(add, base, stream_timeout);
+    n->output_flush_delay   = H2_CONFIG_GET(add, base, output_flush_delay);
+    n->tcp_notsent_lowat    = H2_CONFIG_GET(add, base, tcp_notsent_lowat);
+    n->ctrl_frame_rate      = H2_CONFIG_GET(add, base, ctrl_frame_rate);
+    n->client_ctrl_frame_rate= H2_CONFIG_GET(add, base, client_ctrl_frame_rate);
+    n->hpack_decode_size    = H2_CONFIG_GET(add, base, hpack_decode_size);
+    n->hpack_encode_size    = H2_CONFIG_GET(add, base, hpack_encode_size);
+    n->h2_window_size_max   = H2_CONFIG_GET(add, base, h2_window_size_max);
+    n->early_hints_learn    = H2_CONFIG_GET(add, base, early_hints_learn);
     return n;
 }
 
@@ -278,6 +310,22 @@ static apr_int64_t h2_srv_config_geti64(const h2_config *conf, h2_config_var_t v
             return H2_CONFIG_GET(conf, &defconf, output_buffered);
         case H2_CONF_STREAM_TIMEOUT:
             return H2_CONFIG_GET(conf, &defconf, stream_timeout);
+        case H2_CONF_OUTPUT_FLUSH_DELAY:
+            return H2_CONFIG_GET(conf, &defconf, output_flush_delay);
+        case H2_CONF_TCP_NOTSENT_LOWAT:
+            return H2_CONFIG_GET(conf, &defconf, tcp_notsent_lowat);
+        case H2_CONF_CTRL_FRAME_RATE:
+            return H2_CONFIG_GET(conf, &defconf, ctrl_frame_rate);
+        case H2_CONF_CLIENT_CTRL_FRAME_RATE:
+            return H2_CONFIG_GET(conf, &defconf, client_ctrl_frame_rate);
+        case H2_CONF_HPACK_DECODE_SIZE:
+            return H2_CONFIG_GET(conf, &defconf, hpack_decode_size);
+        case H2_CONF_HPACK_ENCODE_SIZE:
+            return H2_CONFIG_GET(conf, &defconf, hpack_encode_size);
+        case H2_CONF_WIN_SIZE_MAX:
+            return H2_CONFIG_GET(conf, &defconf, h2_window_size_max);
+        case H2_CONF_EARLY_HINTS_LEARN:
+            return H2_CONFIG_GET(conf, &defconf, early_hints_learn);
         default:
             return DEF_VAL;
     }
@@ -340,6 +388,27 @@ static void h2_srv_config_seti(h2_config *conf, h2_config_var_t var, int val)
         case H2_CONF_OUTPUT_BUFFER:
             H2_CONFIG_SET(conf, output_buffered, val);
             break;
+        case H2_CONF_TCP_NOTSENT_LOWAT:
+            H2_CONFIG_SET(conf, tcp_notsent_lowat, val);
+            break;
+        case H2_CONF_CTRL_FRAME_RATE:
+            H2_CONFIG_SET(conf, ctrl_frame_rate, val);
+            break;
+        case H2_CONF_CLIENT_CTRL_FRAME_RATE:
+            H2_CONFIG_SET(conf, client_ctrl_frame_rate, val);
+            break;
+        case H2_CONF_HPACK_DECODE_SIZE:
+            H2_CONFIG_SET(conf, hpack_decode_size, val);
+            break;
+        case H2_CONF_HPACK_ENCODE_SIZE:
+            H2_CONFIG_SET(conf, hpack_encode_size, val);
+            break;
+        case H2_CONF_WIN_SIZE_MAX:
+            H2_CONFIG_SET(conf, h2_window_size_max, val);
+            break;
+        case H2_CONF_EARLY_HINTS_LEARN:
+            H2_CONFIG_SET(conf, early_hints_learn, val);
+            break;
         default:
             break;
     }
@@ -354,6 +423,9 @@ static void h2_srv_config_seti64(h2_config *conf, h2_config_var_t var, apr_int64
         case H2_CONF_STREAM_TIMEOUT:
             H2_CONFIG_SET(conf, stream_timeout, val);
             break;
+        case H2_CONF_OUTPUT_FLUSH_DELAY:
+            H2_CONFIG_SET(conf, output_flush_delay, val);
+            break;
         default:
             h2_srv_config_seti(conf, var, (int)val);
             break;
@@ -502,6 +574,12 @@ apr_array_header_t *h2_config_push_list(request_rec *r)
     return sconf? sconf->push_list : NULL;
 }
 
+apr_array_header_t *h2_config_spush_list(server_rec *s)
+{
+    const h2_config *sconf = h2_config_sget(s);
+    return sconf? sconf->push_list : NULL;
+}
+
 const struct h2_priority *h2_cconfig_get_priority(conn_rec *c, const char *content_type)
 {
     const h2_config *conf = h2_config_get(c);
@@ -535,6 +613,17 @@ static const char *h2_conf_set_window_size(cmd_parms *cmd,
     return NULL;
 }
 
+static const char *h2_conf_set_window_size_max(cmd_parms *cmd,
+                                               void *dirconf, const char *value)
+{
+    apr_int64_t val = apr_atoi64(value);
+    if (val != 0 && (val < 64 * 1024 || val > 1024 * 1024 * 1024)) {
+        return "value must be 0 or between 64KB and 1GB";
+    }
+    CONFIG_CMD_SET(cmd, dirconf, H2_CONF_WIN_SIZE_MAX, (int)val);
+    return NULL;
+}
+
 static const char *h2_conf_set_min_workers(cmd_parms *cmd,
                                            void *dirconf, const char *value)
 {
@@ -825,6 +914,20 @@ static const char *h2_conf_set_early_hints(cmd_parms *cmd,
     return NULL;
 }
 
+static const char *h2_conf_set_early_hints_learn(cmd_parms *cmd,
+                                                 void *dirconf, const char *value)
+{
+    if (!strcasecmp(value, "On")) {
+        CONFIG_CMD_SET(cmd, dirconf, H2_CONF_EARLY_HINTS_LEARN, 1);
+        return NULL;
+    }
+    else if (!strcasecmp(value, "Off")) {
+        CONFIG_CMD_SET(cmd, dirconf, H2_CONF_EARLY_HINTS_LEARN, 0);
+        return NULL;
+    }
+    return "value must be On or Off";
+}
+
 static const char *h2_conf_set_padding(cmd_parms *cmd, void *dirconf, const char *value)
 {
     int val;
@@ -868,6 +971,86 @@ static const char *h2_conf_set_stream_timeout(cmd_parms *cmd,
     return NULL;
 }
 
+static const char *h2_conf_set_output_flush_delay(cmd_parms *cmd,
+                                                  void *dirconf, const char *value)
+{
+    apr_status_t rv;
+    apr_interval_time_t delay;
+    char *end;
+
+    /* ap_timeout_parameter_parse() does not know microseconds */
+    delay = (apr_interval_time_t)apr_strtoi64(value, &end, 10);
+    if (end != value && !strcasecmp(end, "us")) {
+        rv = APR_SUCCESS;
+    }
+    else {
+        rv = ap_timeout_parameter_parse(value, &delay, "ms");
+    }
+    if (rv != APR_SUCCESS || delay < 0) {
+        return "Invalid delay value";
+    }
+    if (delay > apr_time_from_sec(1)) {
+        return "delay must not exceed 1 second";
+    }
+    CONFIG_CMD_SET64(cmd, dirconf, H2_CONF_OUTPUT_FLUSH_DELAY, delay);
+    return NULL;
+}
+
+static const char *h2_conf_set_tcp_notsent_lowat(cmd_parms *cmd,
+                                                 void *dirconf, const char *value)
+{
+    apr_int64_t val = apr_atoi64(value);
+    if (val < 0) {
+        return "value must be >= 0";
+    }
+    if (val > 0 && val < 4096) {
+        return "value must be 0 (off) or >= 4096";
+    }
+    if (val > 64 * 1024 * 1024) {
+        return "value must be <= 64MB";
+    }
+    CONFIG_CMD_SET(cmd, dirconf, H2_CONF_TCP_NOTSENT_LOWAT, (int)val);
+    return NULL;
+}
+
+static const char *h2_conf_set_ctrl_frame_rate(cmd_parms *cmd,
+                                               void *dirconf, const char *value,
+                                               const char *value2)
+{
+    int val = (int)apr_atoi64(value);
+    if (val < 0) {
+        return "value must be >= 0";
+    }
+    CONFIG_CMD_SET(cmd, dirconf, H2_CONF_CTRL_FRAME_RATE, val);
+    if (value2) {
+        val = (int)apr_atoi64(value2);
+        if (val < 0) {
+            return "client value must be >= 0";
+        }
+        CONFIG_CMD_SET(cmd, dirconf, H2_CONF_CLIENT_CTRL_FRAME_RATE, val);
+    }
+    return NULL;
+}
+
+static const char *h2_conf_set_header_table_size(cmd_parms *cmd,
+                                                 void *dirconf, const char *value,
+                                                 const char *value2)
+{
+    apr_int64_t val = apr_atoi64(value);
+    if (val < 0 || val > 1024 * 1024) {
+        return "value must be between 0 and 1MB";
+    }
+    CONFIG_CMD_SET(cmd, dirconf, H2_CONF_HPACK_DECODE_SIZE, (int)val);
+    if (value2) {
+        val = apr_atoi64(value2);
+        if (val < 0 || val > 1024 * 1024) {
+            return "encoder value must be between 0 and 1MB";
+        }
+        CONFIG_CMD_SET(cmd, dirconf, H2_CONF_HPACK_ENCODE_SIZE, (int)val);
+    }
+    return NULL;
+}
+
 void h2_get_num_workers(server_rec *s, int *minw, int *maxw)
 {
     int threads_per_child = 0;
@@ -932,12 +1115,28 @@ const command_rec h2_cmds[] = {
                    OR_FILEINFO|OR_AUTHCFG, "add a resource to be pushed in this location/on this server."),
     AP_INIT_TAKE1("H2EarlyHints", h2_conf_set_early_hints, NULL,
                   RSRC_CONF, "on to enable interim status 103 responses"),
+    AP_INIT_TAKE1("H2EarlyHintsLearn", h2_conf_set_early_hints_learn, NULL,
+                  RSRC_CONF, "on to learn the subresources of pages and "
+                  "announce them in 103 responses"),
     AP_INIT_TAKE1("H2Padding", h2_conf_set_padding, NULL,
                   RSRC_CONF, "set payload padding"),
     AP_INIT_TAKE1("H2OutputBuffering", h2_conf_set_output_buffer, NULL,
                   RSRC_CONF, "set stream output buffer on/off"),
     AP_INIT_TAKE1("H2StreamTimeout", h2_conf_set_stream_timeout, NULL,
                   RSRC_CONF, "set stream timeout"),
+    AP_INIT_TAKE1("H2OutputFlushDelay", h2_conf_set_output_flush_delay, NULL,
+                  RSRC_CONF, "max time non-urgent output may wait for more data"),
+    AP_INIT_TAKE1("H2TCPNotSentLowat", h2_conf_set_tcp_notsent_lowat, NULL,
+                  RSRC_CONF, "max unsent bytes in the connection socket before streams are held back"),
+    AP_INIT_TAKE12("H2ControlFrameRate", h2_conf_set_ctrl_frame_rate, NULL,
+                   RSRC_CONF, "max control frames per second per connection "
+                   "and per client address, 0 to disable"),
+    AP_INIT_TAKE12("H2HeaderTableSize", h2_conf_set_header_table_size, NULL,
+                   RSRC_CONF, "HPACK dynamic table size for request headers "
+                   "and max size for response headers"),
+    AP_INIT_TAKE1("H2MaxWindowSize", h2_conf_set_window_size_max, NULL,
+                  RSRC_CONF, "max size request body windows may grow to, 0 to "
+                  "keep H2WindowSize"),
     AP_END_CMD
 };
 
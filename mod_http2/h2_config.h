@@ -43,6 +43,14 @@ typedef enum {
     H2_CONF_PADDING_ALWAYS,
     H2_CONF_OUTPUT_BUFFER,
     H2_CONF_STREAM_TIMEOUT,
+    H2_CONF_OUTPUT_FLUSH_DELAY,
+    H2_CONF_TCP_NOTSENT_LOWAT,
+    H2_CONF_CTRL_FRAME_RATE,
+    H2_CONF_CLIENT_CTRL_FRAME_RATE,
+    H2_CONF_HPACK_DECODE_SIZE,
+    H2_CONF_HPACK_ENCODE_SIZE,
+    H2_CONF_WIN_SIZE_MAX,
+    H2_CONF_EARLY_HINTS_LEARN,
 } h2_config_var_t;
 
 struct apr_hash_t;
@@ -86,6 +94,7 @@ int h2_config_rgeti(request_rec *r, h2_config_var_t var);
 apr_int64_t h2_config_rgeti64(request_rec *r, h2_config_var_t var);
 
 apr_array_header_t *h2_config_push_list(request_rec *r);
+apr_array_header_t *h2_config_spush_list(server_rec *s);
 
 
 void h2_get_num_workers(server_rec *s, int *minw, int *maxw);
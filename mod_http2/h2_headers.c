@@ -98,13 +98,34 @@ const apr_bucket_type_t h2_bucket_type_headers = {
     apr_bucket_shared_copy
 };
 
+static apr_status_t ngheader_release(void *data)
+{
+    h2_ngheader_unref(data);
+    return APR_SUCCESS;
+}
+
+static h2_headers *headers_take(apr_pool_t *pool, h2_headers *src)
+{
+    h2_headers *headers = apr_pcalloc(pool, sizeof(h2_headers));
+    headers->status    = src->status;
+    headers->headers   = apr_table_make(pool, 1);
+    headers->notes     = apr_table_clone(pool, src->notes);
+    headers->raw_bytes = src->raw_bytes;
+    headers->ngh       = src->ngh;
+    h2_ngheader_ref(headers->ngh);
+    apr_pool_cleanup_register(pool, headers->ngh, ngheader_release,
+                              apr_pool_cleanup_null);
+    return headers;
+}
+
 apr_bucket *h2_bucket_headers_beam(struct h2_bucket_beam *beam,
                                     apr_bucket_brigade *dest,
                                     const apr_bucket *src)
 {
     if (H2_BUCKET_IS_HEADERS(src)) {
         h2_headers *src_headers = ((h2_bucket_headers *)src->data)->headers;
-        apr_bucket *b = h2_bucket_headers_create(dest->bucket_alloc, 
+        apr_bucket *b = h2_bucket_headers_create(dest->bucket_alloc, src_headers->ngh?
+                                                 headers_take(dest->p, src_headers) :
                                                  h2_headers_clone(dest->p, src_headers));
         APR_BRIGADE_INSERT_TAIL(dest, b);
         return b;
@@ -112,6 +133,55 @@ apr_bucket *h2_bucket_headers_beam(struct h2_bucket_beam *beam,
     return NULL;
 }
 
+apr_status_t h2_headers_flatten(h2_headers *headers, apr_pool_t *pool,
+                                h2_ngheader_cache *cache)
+{
+    apr_status_t rv;
+
+    if (headers->ngh) {
+        return APR_SUCCESS;
+    }
+    rv = h2_res_make_ngheader(&headers->ngh, headers, cache);
+    if (APR_SUCCESS == rv) {
+        apr_pool_cleanup_register(pool, headers->ngh, ngheader_release,
+                                  apr_pool_cleanup_null);
+    }
+    return rv;
+}
+
+const char *h2_headers_get(h2_headers *headers, const char *lname)
+{
+    return headers->ngh? h2_ngheader_get(headers->ngh, lname)
+                       : apr_table_get(headers->headers, lname);
+}
+
+void h2_headers_do(h2_headers *headers, apr_table_do_callback_fn_t *cb, void *ctx)
+{
+    apr_size_t i;
+
+    if (!headers->ngh) {
+        apr_table_do(cb, ctx, headers->headers, NULL);
+        return;
+    }
+    for (i = 0; i < headers->ngh->nvlen; ++i) {
+        const nghttp2_nv *nv = &headers->ngh->nv[i];
+        if (nv->name[0] != ':' 
+            && !cb(ctx, (const char *)nv->name, (const char *)nv->value)) {
+            break;
+        }
+    }
+}
+
+apr_status_t h2_headers_set_static(h2_headers *headers, const char *lname,
+                                   const char *value)
+{
+    if (headers->ngh) {
+        return h2_ngheader_set_static(headers->ngh, lname, value);
+    }
+    apr_table_setn(headers->headers, lname, value);
+    return APR_SUCCESS;
+}
+
 
 h2_headers *h2_headers_create(int status, const apr_table_t *headers_in, 
                               const apr_table_t *notes, apr_off_t raw_bytes,
@@ -147,9 +217,14 @@ apr_size_t h2_bucket_headers_headers_length(apr_bucket *b)
 }
 
 h2_headers *h2_headers_rcreate(request_rec *r, int status,
-                               const apr_table_t *header, apr_pool_t *pool)
+                               apr_table_t *header, apr_pool_t *pool)
 {
-    h2_headers *headers = h2_headers_create(status, header, r->notes, 0, pool);
+    h2_headers *headers = apr_pcalloc(pool, sizeof(h2_headers));
+
+    headers->status  = status;
+    headers->headers = header? header : apr_table_make(pool, 5);
+    /* c1 only looks at the notes we set here */
+    headers->notes   = apr_table_make(pool, 2);
     if (headers->status == HTTP_FORBIDDEN) {
         request_rec *r_prev;
         for (r_prev = r; r_prev != NULL; r_prev = r_prev->prev) {
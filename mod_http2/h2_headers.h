@@ -20,6 +20,7 @@
 #include "h2.h"
 
 struct h2_bucket_beam;
+struct h2_ngheader_cache;
 
 extern const apr_bucket_type_t h2_bucket_type_headers;
 
@@ -52,11 +53,41 @@ h2_headers *h2_headers_create(int status, const apr_table_t *header,
  * Create the headers from the given request_rec.
  * @param r the request record which was processed
  * @param status the headers status
- * @param header the headers of the headers
+ * @param header the headers of the headers, taken over without copying
  * @param pool the memory pool to use
  */
 h2_headers *h2_headers_rcreate(request_rec *r, int status, 
-                               const apr_table_t *header, apr_pool_t *pool);
+                               apr_table_t *header, apr_pool_t *pool);
+
+/**
+ * Make the HTTP/2 form of the header fields, see h2_res_make_ngheader().
+ * It is released with the given pool. When beamed to c1, the
+ * fields are handed over as they are and the table stays behind.
+ * @param headers the headers to flatten, no-op if already done
+ * @param pool the pool that holds the reference of the caller
+ * @param cache the session's cache of header sets or NULL
+ */
+apr_status_t h2_headers_flatten(h2_headers *headers, apr_pool_t *pool,
+                                struct h2_ngheader_cache *cache);
+
+/**
+ * Get a header field value, flattened or not.
+ * @param lname the lower-case field name
+ */
+const char *h2_headers_get(h2_headers *headers, const char *lname);
+
+/**
+ * Call cb for all header fields, flattened or not. Pseudo header
+ * fields are skipped.
+ */
+void h2_headers_do(h2_headers *headers, apr_table_do_callback_fn_t *cb, void *ctx);
+
+/**
+ * Set a header field to a value that lives forever.
+ * @param lname the lower-case field name
+ */
+apr_status_t h2_headers_set_static(h2_headers *headers, const char *lname,
+                                   const char *value);
 
 /**
  * Copy the headers into another pool. This will not copy any
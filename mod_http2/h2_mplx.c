@@ -250,6 +250,9 @@ h2_mplx *h2_mplx_c1_create(h2_stream *stream0, server_rec *s, apr_pool_t *parent
                       "nghttp2: could not create pollset");
         goto failure;
     }
+    status = h2_ngheader_cache_create(&m->ngh_cache, m->pool);
+    if (APR_SUCCESS != status) goto failure;
+
     m->streams_to_poll = apr_array_make(m->pool, 10, sizeof(h2_stream*));
     m->streams_ev_in = apr_array_make(m->pool, 10, sizeof(h2_stream*));
     m->streams_ev_out = apr_array_make(m->pool, 10, sizeof(h2_stream*));
@@ -536,6 +539,130 @@ cleanup:
     return rv;
 }
 
+static int m_can_suspend(h2_mplx *m)
+{
+    return !m->aborted && !m->polling
+        && h2_iq_empty(m->q) && !m->streams_to_poll->nelts;
+}
+
+int h2_mplx_c1_can_suspend(h2_mplx *m)
+{
+#if H2_POLL_STREAMS
+    int rv;
+
+    H2_MPLX_ENTER_ALWAYS(m);
+    rv = m_can_suspend(m);
+    H2_MPLX_LEAVE(m);
+    return rv;
+#else
+    (void)m;
+    return 0;
+#endif
+}
+
+#if H2_POLL_STREAMS
+static void m_add_pfd(apr_array_header_t *pfds, const apr_pollfd_t *pfd)
+{
+    if (pfd->reqevents) {
+        *(apr_pollfd_t *)apr_array_push(pfds) = *pfd;
+    }
+}
+
+static int m_suspend_pfds_iter(void *ctx, void *val)
+{
+    apr_array_header_t *pfds = ctx;
+    h2_stream *stream = val;
+    h2_conn_ctx_t *conn_ctx;
+
+    if (stream->c2 && (conn_ctx = h2_conn_ctx_get(stream->c2))) {
+        m_add_pfd(pfds, &conn_ctx->pfd_out_prod);
+        m_add_pfd(pfds, &conn_ctx->pfd_in_drain);
+    }
+    return 1;
+}
+#endif
+
+apr_status_t h2_mplx_c1_suspend_pfds(h2_mplx *m, apr_pool_t *p,
+                                     apr_array_header_t **ppfds)
+{
+#if H2_POLL_STREAMS
+    apr_array_header_t *pfds;
+    apr_status_t rv = APR_SUCCESS;
+
+    *ppfds = NULL;
+    H2_MPLX_ENTER(m);
+    if (!m_can_suspend(m)) {
+        rv = APR_EAGAIN;
+        goto cleanup;
+    }
+    pfds = apr_array_make(p, 2 * (int)h2_ihash_count(m->streams) + 1,
+                          sizeof(apr_pollfd_t));
+    /* the MPM sets its own client_data, these have to be copies */
+    m_add_pfd(pfds, &h2_conn_ctx_get(m->c1)->pfd_out_prod);
+    h2_ihash_iter(m->streams, m_suspend_pfds_iter, pfds);
+    *ppfds = pfds;
+
+cleanup:
+    H2_MPLX_LEAVE(m);
+    return rv;
+#else
+    (void)m;
+    (void)p;
+    *ppfds = NULL;
+    return APR_ENOTIMPL;
+#endif
+}
+
+static int m_status_stream_iter(void *ctx, void *val)
+{
+    apr_array_header_t *streams = ctx;
+    h2_stream *stream = val;
+    h2_conn_ctx_t *conn_ctx = stream->c2? h2_conn_ctx_get(stream->c2) : NULL;
+    h2_mplx_stream_status *ss;
+    apr_time_t now = apr_time_now();
+
+    ss = apr_array_push(streams);
+    memset(ss, 0, sizeof(*ss));
+    ss->id = stream->id;
+    ss->state = h2_stream_state_str(stream);
+    ss->in_data_octets = stream->in_data_octets;
+    ss->out_data_octets = stream->out_data_octets;
+    if (stream->input) {
+        ss->in_buffered = h2_beam_get_buffered(stream->input);
+    }
+    if (stream->output) {
+        ss->out_buffered = h2_beam_get_buffered(stream->output);
+    }
+    if (conn_ctx && conn_ctx->started_at) {
+        ss->queued = conn_ctx->started_at - stream->created;
+        ss->done = conn_ctx->done;
+        ss->processing = (conn_ctx->done? conn_ctx->done_at : now)
+                         - conn_ctx->started_at;
+    }
+    else {
+        ss->queued = now - stream->created;
+    }
+    return 1;
+}
+
+apr_status_t h2_mplx_get_status(h2_mplx *m, apr_pool_t *p, h2_mplx_status *status)
+{
+    memset(status, 0, sizeof(*status));
+    H2_MPLX_ENTER(m);
+    status->stream_count = (int)h2_ihash_count(m->streams);
+    status->queued = h2_iq_count(m->q);
+    status->processing_count = m->processing_count;
+    status->processing_limit = m->processing_limit;
+    status->processing_max = m->processing_max;
+    status->responses_native = (int)apr_atomic_read32(&m->responses_native);
+    status->responses_h1 = (int)apr_atomic_read32(&m->responses_h1);
+    status->streams = apr_array_make(p, status->stream_count + 1,
+                                     sizeof(h2_mplx_stream_status));
+    h2_ihash_iter(m->streams, m_status_stream_iter, status->streams);
+    H2_MPLX_LEAVE(m);
+    return APR_SUCCESS;
+}
+
 apr_status_t h2_mplx_c1_reprioritize(h2_mplx *m, h2_stream_pri_cmp_fn *cmp,
                                     h2_session *session)
 {
@@ -41,6 +41,7 @@ struct h2_request;
 struct apr_thread_cond_t;
 struct h2_workers;
 struct h2_iqueue;
+struct h2_ngheader_cache;
 
 #include <apr_queue.h>
 
@@ -89,6 +90,9 @@ struct h2_mplx {
     struct h2_iqueue *streams_output_written; /* streams whose output has been written to */
 #endif
     struct h2_workers *workers;     /* h2 workers process wide instance */
+    struct h2_ngheader_cache *ngh_cache; /* response header sets seen by c2s */
+    volatile apr_uint32_t responses_native; /* c2 responses made as h2_headers */
+    volatile apr_uint32_t responses_h1; /* c2 responses parsed from HTTP/1.1 */
 
     request_rec *scratch_r;         /* pseudo request_rec for scoreboard reporting */
 };
@@ -171,6 +175,59 @@ apr_status_t h2_mplx_c1_poll(h2_mplx *m, apr_interval_time_t timeout,
                             stream_ev_callback *on_stream_output,
                             void *on_ctx);
 
+/**
+ * Check if c1 could stop polling and leave watching the primary
+ * connection and the active streams to the MPM. This is not the
+ * case when streams are queued for processing or have not been
+ * added to the pollset yet, since workers might then start output
+ * on pipes we do not know of.
+ */
+int h2_mplx_c1_can_suspend(h2_mplx *m);
+
+/**
+ * Get copies of the poll descriptors for c1 input and the output and
+ * input pipes of all streams being processed, to be handed to the MPM.
+ * @param m the mplx
+ * @param p the pool to allocate the descriptors from
+ * @param ppfds the array of apr_pollfd_t on success
+ * @return APR_EAGAIN when c1 can no longer suspend,
+ *         APR_ENOTIMPL when streams are not polled on this platform
+ */
+apr_status_t h2_mplx_c1_suspend_pfds(h2_mplx *m, apr_pool_t *p,
+                                     apr_array_header_t **ppfds);
+
+typedef struct {
+    int id;                         /* stream identifier */
+    const char *state;              /* name of the stream state */
+    apr_off_t in_data_octets;       /* request body bytes received */
+    apr_off_t out_data_octets;      /* response body bytes sent */
+    apr_off_t in_buffered;          /* bytes waiting in the input beam */
+    apr_off_t out_buffered;         /* bytes waiting in the output beam */
+    apr_interval_time_t queued;     /* time from creation to processing */
+    apr_interval_time_t processing; /* time c2 is/was processing */
+    int done;                       /* c2 processing has finished */
+} h2_mplx_stream_status;
+
+typedef struct {
+    int stream_count;               /* streams known to the mplx */
+    int queued;                     /* streams waiting to be processed */
+    int processing_count;           /* streams processing in c2 */
+    int processing_limit;           /* current limit on processing c2s */
+    int processing_max;             /* hard limit on processing c2s */
+    int responses_native;           /* c2 responses made as h2_headers */
+    int responses_h1;               /* c2 responses parsed from HTTP/1.1 */
+    apr_array_header_t *streams;    /* of h2_mplx_stream_status */
+} h2_mplx_status;
+
+/**
+ * Get a snapshot of the mplx and its streams. May be called from any
+ * thread. The mplx is only locked while copying the numbers.
+ * @param m the mplx
+ * @param p the pool to allocate the status from
+ * @param status the status to fill
+ */
+apr_status_t h2_mplx_get_status(h2_mplx *m, apr_pool_t *p, h2_mplx_status *status);
+
 void h2_mplx_c2_input_read(h2_mplx *m, conn_rec *c2);
 void h2_mplx_c2_output_written(h2_mplx *m, conn_rec *c2);
 
@@ -46,6 +46,7 @@ typedef struct h2_proxy_stream {
     unsigned int waiting_on_100 : 1;
     unsigned int waiting_on_ping : 1;
     unsigned int headers_ended : 1;
+    unsigned int handed : 1;   /* res_data took the response, r is not ours */
     uint32_t error_code;
 
     apr_bucket_brigade *input;
@@ -192,6 +193,14 @@ static apr_status_t proxy_session_pre_close(void *theconn)
                       (int)h2_proxy_ihash_count(session->streams));
         session->aborted = 1;
         dispatch_event(session, H2_PROXYS_EV_PRE_CLOSE, 0, NULL);
+#ifdef H2_NG2_MEM
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, session->c, 
+                      "proxy_session(%s): nghttp2 memory: %ld allocs, %ld reused, "
+                      "%ld large, peak %ld bytes, pool %ld bytes", session->id,
+                      (long)session->ngmem->allocs, (long)session->ngmem->reused,
+                      (long)session->ngmem->large, (long)session->ngmem->peak,
+                      (long)session->ngmem->arena);
+#endif
         nghttp2_session_del(session->ngh2);
         session->ngh2 = NULL;
         p_conn->data = NULL;
@@ -415,6 +424,11 @@ static apr_status_t h2_proxy_stream_add_header_out(h2_proxy_stream *stream,
     ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, stream->session->c, 
                   "h2_proxy_stream(%s-%d): on_header %s: %s", 
                   stream->session->id, stream->id, n, v);
+    if (stream->handed) {
+        /* another thread is passing the response, trailers of
+         * r can no longer be changed from here */
+        return APR_SUCCESS;
+    }
     if (!h2_proxy_res_ignore_header(n, nlen)) {
         char *hname, *hvalue;
         apr_table_t *headers = (stream->headers_ended? 
@@ -517,6 +531,7 @@ static int stream_response_data(nghttp2_session *ngh2, uint8_t flags,
                      "h2_proxy_session(%s): recv data chunk for "
                      "unknown stream %d, ignored", 
                      session->id, stream_id);
+        nghttp2_session_consume(ngh2, stream_id, len);
         return 0;
     }
     
@@ -527,6 +542,17 @@ static int stream_response_data(nghttp2_session *ngh2, uint8_t flags,
     }
     stream->data_received += len;
     
+#ifdef H2_NG2_CONSUME_STREAM
+    if (session->res_data
+        && session->res_data(session, stream->r, stream_id, (const char*)data, len, 0)) {
+        /* The stream's window opens when the taker has passed the data
+         * on, that limits what a slow client leaves buffered. */
+        stream->handed = 1;
+        nghttp2_session_consume_connection(ngh2, len);
+        return 0;
+    }
+#endif
+    
     b = apr_bucket_transient_create((const char*)data, len, 
                                     stream->r->connection->bucket_alloc);
     APR_BRIGADE_INSERT_TAIL(stream->output, b);
@@ -536,6 +562,7 @@ static int stream_response_data(nghttp2_session *ngh2, uint8_t flags,
     APR_BRIGADE_INSERT_TAIL(stream->output, b);
     
     status = ap_pass_brigade(stream->r->output_filters, stream->output);
+    nghttp2_session_consume(ngh2, stream_id, len);
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, status, stream->r, APLOGNO(03359)
                   "h2_proxy_session(%s): stream=%d, response DATA %ld, %ld"
                   " total", session->id, stream_id, (long)len,
@@ -758,9 +785,16 @@ h2_proxy_session *h2_proxy_session_setup(const char *id, proxy_conn_rec *p_conn,
 #endif
         nghttp2_option_new(&option);
         nghttp2_option_set_peer_max_concurrent_streams(option, 100);
-        nghttp2_option_set_no_auto_window_update(option, 0);
+        /* DATA is consumed when passed on, see stream_response_data() */
+        nghttp2_option_set_no_auto_window_update(option, 1);
         
+#ifdef H2_NG2_MEM
+        session->ngmem = h2_proxy_ngmem_create(pool);
+        nghttp2_session_client_new3(&session->ngh2, cbs, session, option,
+                                    &session->ngmem->mem);
+#else
         nghttp2_session_client_new2(&session->ngh2, cbs, session, option);
+#endif
         
         nghttp2_option_del(option);
         nghttp2_session_callbacks_del(cbs);
@@ -1178,6 +1212,23 @@ static int is_accepting_streams(h2_proxy_session *session)
     }
 }
 
+int h2_proxy_session_is_accepting(h2_proxy_session *session)
+{
+    return (session->state == H2_PROXYS_ST_INIT) || is_accepting_streams(session);
+}
+
+static int wait_expired(h2_proxy_session *session)
+{
+    apr_interval_time_t timeout = -1;
+    apr_socket_t *socket;
+
+    socket = ap_get_conn_socket(session->c);
+    if (socket) {
+        apr_socket_timeout_get(socket, &timeout);
+    }
+    return timeout >= 0 && (apr_time_now() - session->wait_start) >= timeout;
+}
+
 static void transit(h2_proxy_session *session, const char *action, 
                     h2_proxys_state nstate)
 {
@@ -1354,7 +1405,9 @@ static void ev_stream_done(h2_proxy_session *session, int stream_id,
                       session->id, stream_id, touched, stream->error_code);
         
         if (status != APR_SUCCESS) {
-            stream->r->status = 500;
+            if (!stream->handed) {
+                stream->r->status = 500;
+            }
         }
         else if (!stream->data_received) {
             apr_bucket *b;
@@ -1362,11 +1415,14 @@ static void ev_stream_done(h2_proxy_session *session, int stream_id,
              * an empty brigade which will also write the response headers */
             h2_proxy_stream_end_headers_out(stream);
             stream->data_received = 1;
-            b = apr_bucket_flush_create(stream->r->connection->bucket_alloc);
-            APR_BRIGADE_INSERT_TAIL(stream->output, b);
-            b = apr_bucket_eos_create(stream->r->connection->bucket_alloc);
-            APR_BRIGADE_INSERT_TAIL(stream->output, b);
-            ap_pass_brigade(stream->r->output_filters, stream->output);
+            if (!session->res_data
+                || !session->res_data(session, stream->r, stream_id, NULL, 0, 1)) {
+                b = apr_bucket_flush_create(stream->r->connection->bucket_alloc);
+                APR_BRIGADE_INSERT_TAIL(stream->output, b);
+                b = apr_bucket_eos_create(stream->r->connection->bucket_alloc);
+                APR_BRIGADE_INSERT_TAIL(stream->output, b);
+                ap_pass_brigade(stream->r->output_filters, stream->output);
+            }
         }
         
         stream->state = H2_STREAM_ST_CLOSED;
@@ -1545,12 +1601,22 @@ run_loop:
                 /* we can do a blocking read with the default timeout (as
                  * configured via ProxyTimeout in our socket. There is
                  * nothing we want to send or check until we get more data
-                 * from the backend. */
-                status = h2_proxy_session_read(session, 1, 0);
+                 * from the backend.
+                 * A session shared by several requests returns to its
+                 * caller every max_wait, so that new requests get in. */
+                if (!session->wait_start) {
+                    session->wait_start = apr_time_now();
+                }
+                status = h2_proxy_session_read(session, 1, session->max_wait);
                 if (status == APR_SUCCESS) {
                     have_read = 1;
+                    session->wait_start = 0;
                     dispatch_event(session, H2_PROXYS_EV_DATA_READ, 0, NULL);
                 }
+                else if (session->max_wait > 0 && APR_STATUS_IS_TIMEUP(status)
+                         && !wait_expired(session)) {
+                    /* nop, still waiting */
+                }
                 else {
                     dispatch_event(session, H2_PROXYS_EV_CONN_ERROR, status, NULL);
                     return status;
@@ -1601,6 +1667,7 @@ run_loop:
 
     if (have_read || have_written) {
         session->wait_timeout = 0;
+        session->wait_start = 0;
     }
     
     if (!nghttp2_session_want_read(session->ngh2)
@@ -1639,6 +1706,41 @@ void h2_proxy_session_cancel_all(h2_proxy_session *session)
     }
 }
 
+typedef struct {
+    h2_proxy_session *session;
+    request_rec *r;
+} cancel_req_ctx;
+
+static int cancel_req_iter(void *udata, void *val)
+{
+    cancel_req_ctx *ctx = udata;
+    h2_proxy_stream *stream = val;
+    if (stream->r == ctx->r) {
+        nghttp2_submit_rst_stream(ctx->session->ngh2, NGHTTP2_FLAG_NONE,
+                                  stream->id, NGHTTP2_CANCEL);
+        return 0;
+    }
+    return 1;
+}
+
+void h2_proxy_session_cancel(h2_proxy_session *session, request_rec *r)
+{
+    cancel_req_ctx ctx;
+    ctx.session = session;
+    ctx.r = r;
+    h2_proxy_ihash_iter(session->streams, cancel_req_iter, &ctx);
+}
+
+void h2_proxy_session_consumed(h2_proxy_session *session, int stream_id,
+                               apr_size_t len)
+{
+#ifdef H2_NG2_CONSUME_STREAM
+    nghttp2_session_consume_stream(session->ngh2, stream_id, len);
+#else
+    (void)session;(void)stream_id;(void)len;
+#endif
+}
+
 static int done_iter(void *udata, void *val)
 {
     cleanup_iter_ctx *ctx = udata;
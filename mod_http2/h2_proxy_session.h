@@ -23,6 +23,7 @@
 
 struct h2_proxy_iqueue;
 struct h2_proxy_ihash_t;
+struct h2_proxy_ngmem;
 
 typedef enum {
     H2_STREAM_ST_IDLE,
@@ -69,6 +70,15 @@ typedef enum {
 typedef struct h2_proxy_session h2_proxy_session;
 typedef void h2_proxy_request_done(h2_proxy_session *s, request_rec *r,
                                    apr_status_t status, int touched);
+/**
+ * Offered the response DATA of request `r` before the session passes it
+ * to r's output filters. Returns != 0 when it took the data over, then
+ * the stream's window is only opened again by h2_proxy_session_consumed().
+ * `eos` is set for a response without body, which then ends with `len` 0.
+ */
+typedef int h2_proxy_response_data(h2_proxy_session *s, request_rec *r,
+                                   int stream_id, const char *data,
+                                   apr_size_t len, int eos);
 
 struct h2_proxy_session {
     const char *id;
@@ -77,11 +87,13 @@ struct h2_proxy_session {
     proxy_server_conf *conf;
     apr_pool_t *pool;
     nghttp2_session *ngh2;   /* the nghttp2 session itself */
+    struct h2_proxy_ngmem *ngmem; /* nghttp2's allocator, NULL for malloc() */
     
     unsigned int aborted : 1;
     unsigned int h2_front : 1; /* if front-end connection is HTTP/2 */
 
     h2_proxy_request_done *done;
+    h2_proxy_response_data *res_data; /* optional taker of response DATA */
     void *user_data;
     
     unsigned char window_bits_stream;
@@ -89,6 +101,8 @@ struct h2_proxy_session {
 
     h2_proxys_state state;
     apr_interval_time_t wait_timeout;
+    apr_interval_time_t max_wait; /* bound for blocking reads, 0 for none */
+    apr_time_t wait_start;  /* when the current wait on the backend began */
 
     struct h2_proxy_ihash_t *streams;
     struct h2_proxy_iqueue *suspended;
@@ -124,10 +138,26 @@ apr_status_t h2_proxy_session_submit(h2_proxy_session *s, const char *url,
  */
 apr_status_t h2_proxy_session_process(h2_proxy_session *s);
 
+/**
+ * Return != 0 iff the session may still take new streams.
+ */
+int h2_proxy_session_is_accepting(h2_proxy_session *s);
+
 void h2_proxy_session_cancel_all(h2_proxy_session *s);
 
+/**
+ * Reset the stream of request `r`, other streams keep on running.
+ */
+void h2_proxy_session_cancel(h2_proxy_session *s, request_rec *r);
+
 void h2_proxy_session_cleanup(h2_proxy_session *s, h2_proxy_request_done *done);
 
+/**
+ * Report that `len` bytes of DATA taken over by the session's res_data
+ * callback for stream `stream_id` have been passed on.
+ */
+void h2_proxy_session_consumed(h2_proxy_session *s, int stream_id, apr_size_t len);
+
 #define H2_PROXY_REQ_URL_NOTE   "h2-proxy-req-url"
 
 #endif /* h2_proxy_session_h */
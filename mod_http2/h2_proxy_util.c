@@ -15,6 +15,7 @@
  */
  
 #include <assert.h>
+#include <stdlib.h>
 #include <apr_lib.h>
 #include <apr_strings.h>
 #include <apr_thread_mutex.h>
@@ -468,6 +469,145 @@ h2_proxy_ngheader *h2_proxy_util_nghd_make(apr_pool_t *p, apr_table_t *headers)
     return ngh;
 }
 
+#ifdef H2_NG2_MEM
+#define H2_PROXY_NGMEM_MIN_SHIFT  5
+#define H2_PROXY_NGMEM_CLASSES    (sizeof(((h2_proxy_ngmem *)0)->freelist)/sizeof(void*))
+#define H2_PROXY_NGMEM_LARGE      ((apr_size_t)-1)
+
+/* In front of every allocation, keeps the pool's alignment */
+typedef union {
+    struct {
+        apr_size_t cls;         /* size class or H2_PROXY_NGMEM_LARGE */
+        apr_size_t size;        /* size asked for */
+    } a;
+    void *next;                 /* when on a freelist */
+    char align[16];
+} ngmem_hdr;
+
+static apr_size_t ngmem_class(size_t size)
+{
+    apr_size_t cls = 0;
+    
+    while ((((size_t)1) << (cls + H2_PROXY_NGMEM_MIN_SHIFT)) < size) {
+        if (++cls >= H2_PROXY_NGMEM_CLASSES) {
+            return H2_PROXY_NGMEM_LARGE;
+        }
+    }
+    return cls;
+}
+
+static void *ngmem_malloc(size_t size, void *mem_user_data)
+{
+    h2_proxy_ngmem *m = mem_user_data;
+    apr_size_t cls = ngmem_class(size);
+    ngmem_hdr *h;
+
+    if (cls == H2_PROXY_NGMEM_LARGE) {
+        h = malloc(sizeof(*h) + size);
+        if (!h) {
+            return NULL;
+        }
+        ++m->large;
+    }
+    else if (m->freelist[cls]) {
+        h = m->freelist[cls];
+        m->freelist[cls] = h->next;
+        ++m->reused;
+    }
+    else {
+        apr_size_t len = sizeof(*h) + (((apr_size_t)1) << (cls + H2_PROXY_NGMEM_MIN_SHIFT));
+        h = apr_palloc(m->pool, len);
+        m->arena += len;
+    }
+    h->a.cls = cls;
+    h->a.size = size;
+    ++m->allocs;
+    m->in_use += size;
+    if (m->in_use > m->peak) {
+        m->peak = m->in_use;
+    }
+    return h + 1;
+}
+
+static void ngmem_free(void *ptr, void *mem_user_data)
+{
+    h2_proxy_ngmem *m = mem_user_data;
+    ngmem_hdr *h;
+
+    if (!ptr) {
+        return;
+    }
+    h = ((ngmem_hdr *)ptr) - 1;
+    m->in_use -= h->a.size;
+    if (h->a.cls == H2_PROXY_NGMEM_LARGE) {
+        free(h);
+    }
+    else {
+        apr_size_t cls = h->a.cls;
+        h->next = m->freelist[cls];
+        m->freelist[cls] = h;
+    }
+}
+
+static void *ngmem_calloc(size_t nmemb, size_t size, void *mem_user_data)
+{
+    void *ptr;
+
+    if (size && nmemb > ((size_t)-1) / size) {
+        return NULL;
+    }
+    ptr = ngmem_malloc(nmemb * size, mem_user_data);
+    if (ptr) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+static void *ngmem_realloc(void *ptr, size_t size, void *mem_user_data)
+{
+    h2_proxy_ngmem *m = mem_user_data;
+    ngmem_hdr *h;
+    void *nptr;
+
+    if (!ptr) {
+        return ngmem_malloc(size, mem_user_data);
+    }
+    if (!size) {
+        ngmem_free(ptr, mem_user_data);
+        return NULL;
+    }
+    h = ((ngmem_hdr *)ptr) - 1;
+    if (h->a.cls != H2_PROXY_NGMEM_LARGE && h->a.cls == ngmem_class(size)) {
+        /* still fits */
+        m->in_use = m->in_use - h->a.size + size;
+        if (m->in_use > m->peak) {
+            m->peak = m->in_use;
+        }
+        h->a.size = size;
+        return ptr;
+    }
+    nptr = ngmem_malloc(size, mem_user_data);
+    if (nptr) {
+        memcpy(nptr, ptr, H2MIN(h->a.size, size));
+        ngmem_free(ptr, mem_user_data);
+    }
+    return nptr;
+}
+
+h2_proxy_ngmem *h2_proxy_ngmem_create(apr_pool_t *pool)
+{
+    h2_proxy_ngmem *m = apr_pcalloc(pool, sizeof(*m));
+
+    m->pool = pool;
+    m->mem.mem_user_data = m;
+    m->mem.malloc = ngmem_malloc;
+    m->mem.free = ngmem_free;
+    m->mem.calloc = ngmem_calloc;
+    m->mem.realloc = ngmem_realloc;
+    return m;
+}
+#endif /* H2_NG2_MEM */
+
 /*******************************************************************************
  * header HTTP/1 <-> HTTP/2 conversions
  ******************************************************************************/
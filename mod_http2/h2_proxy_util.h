@@ -170,6 +170,35 @@ h2_proxy_ngheader *h2_proxy_util_nghd_make_req(apr_pool_t *p,
 
 h2_proxy_ngheader *h2_proxy_util_nghd_make(apr_pool_t *p, apr_table_t *headers);
 
+#ifdef H2_NG2_MEM
+/**
+ * A nghttp2_mem that allocates from a pool. Freed memory goes on
+ * freelists by power of 2 size classes and is reused for the next
+ * allocation of that class. Large ones come from malloc().
+ * The pool frees all of it in one step, so it must live longer than
+ * the nghttp2 session. Not thread-safe, like the nghttp2 session.
+ */
+typedef struct h2_proxy_ngmem h2_proxy_ngmem;
+
+struct h2_proxy_ngmem {
+    nghttp2_mem mem;            /* give this to nghttp2 */
+    apr_pool_t *pool;
+    void *freelist[12];         /* 32 bytes to 64 KB */
+
+    apr_size_t allocs;          /* # of allocations */
+    apr_size_t reused;          /* # of allocations taken from a freelist */
+    apr_size_t large;           /* # of allocations too large for the pool */
+    apr_size_t in_use;          /* bytes currently allocated */
+    apr_size_t peak;            /* max of in_use seen */
+    apr_size_t arena;           /* bytes taken from the pool */
+};
+
+/**
+ * Create a nghttp2 allocator for the pool.
+ */
+h2_proxy_ngmem *h2_proxy_ngmem_create(apr_pool_t *pool);
+#endif /* H2_NG2_MEM */
+
 /*******************************************************************************
  * h2_proxy_request helpers
  ******************************************************************************/
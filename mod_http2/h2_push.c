@@ -21,6 +21,7 @@
 #include <apr_strings.h>
 #include <apr_hash.h>
 #include <apr_time.h>
+#include <apr_thread_mutex.h>
 
 #ifdef H2_OPENSSL
 #include <openssl/evp.h>
@@ -31,6 +32,7 @@
 #include <http_log.h>
 
 #include "h2_private.h"
+#include "h2_config.h"
 #include "h2_protocol.h"
 #include "h2_util.h"
 #include "h2_push.h"
@@ -43,6 +45,35 @@
  * link header handling 
  ******************************************************************************/
 
+#define FNV1A_BASIS     APR_UINT64_C(0xcbf29ce484222325)
+
+static apr_uint64_t fnv1a_updaten(apr_uint64_t val, const char *s, apr_size_t len)
+{
+    apr_size_t i;
+
+    for (i = 0; i < len; ++i) {
+        val ^= (unsigned char)s[i];
+        val *= APR_UINT64_C(0x100000001b3);
+    }
+    return val;
+}
+
+static apr_uint64_t fnv1a_update(apr_uint64_t val, const char *s)
+{
+    return fnv1a_updaten(val, s, strlen(s));
+}
+
+static apr_uint64_t push_url_hash(const char *scheme, const char *authority,
+                                  const char *path)
+{
+    apr_uint64_t val = FNV1A_BASIS;
+
+    val = fnv1a_update(val, scheme);
+    val = fnv1a_update(val, "://");
+    val = fnv1a_update(val, authority);
+    return fnv1a_update(val, path);
+}
+
 static const char *policy_str(h2_push_policy policy)
 {
     switch (policy) {
@@ -315,6 +346,42 @@ static int has_relation(link_ctx *ctx, const char *rel)
     return 0;
 }
 
+static void push_create(link_ctx *ctx, const char *path, int critical,
+                        apr_uint64_t url_hash)
+{
+    const char *method;
+    apr_table_t *headers;
+    h2_request *req;
+    h2_push *push;
+
+    push = apr_pcalloc(ctx->pool, sizeof(*push));
+    switch (ctx->push_policy) {
+        case H2_PUSH_HEAD:
+            method = "HEAD";
+            break;
+        default:
+            method = "GET";
+            break;
+    }
+    headers = apr_table_make(ctx->pool, 5);
+    apr_table_do(set_push_header, headers, ctx->req->headers, NULL);
+    req = h2_request_create(0, ctx->pool, method, ctx->req->scheme,
+                            ctx->req->authority, path, headers);
+    /* atm, we do not push on pushes */
+    h2_request_end_headers(req, ctx->pool, 1, 0);
+    push->req = req;
+    push->url_hash = url_hash;
+    if (critical) {
+        h2_priority *prio = apr_pcalloc(ctx->pool, sizeof(*prio));
+        prio->dependency = H2_DEPENDANT_BEFORE;
+        push->priority = prio;
+    }
+    if (!ctx->pushes) {
+        ctx->pushes = apr_array_make(ctx->pool, 5, sizeof(h2_push*));
+    }
+    APR_ARRAY_PUSH(ctx->pushes, h2_push*) = push;
+}
+
 static int add_push(link_ctx *ctx)
 {
     /* so, we have read a Link header and need to decide
@@ -325,11 +392,7 @@ static int add_push(link_ctx *ctx)
         if (apr_uri_parse(ctx->pool, ctx->link, &uri) == APR_SUCCESS) {
             if (uri.path && same_authority(ctx->req, &uri)) {
                 char *path;
-                const char *method;
-                apr_table_t *headers;
-                h2_request *req;
-                h2_push *push;
-                
+
                 /* We only want to generate pushes for resources in the
                  * same authority than the original request.
                  * icing: i think that is wise, otherwise we really need to
@@ -337,31 +400,8 @@ static int add_push(link_ctx *ctx)
                  * TLS (if any) parameters.
                  */
                 path = apr_uri_unparse(ctx->pool, &uri, APR_URI_UNP_OMITSITEPART);
-                push = apr_pcalloc(ctx->pool, sizeof(*push));
-                switch (ctx->push_policy) {
-                    case H2_PUSH_HEAD:
-                        method = "HEAD";
-                        break;
-                    default:
-                        method = "GET";
-                        break;
-                }
-                headers = apr_table_make(ctx->pool, 5);
-                apr_table_do(set_push_header, headers, ctx->req->headers, NULL);
-                req = h2_request_create(0, ctx->pool, method, ctx->req->scheme,
-                                        ctx->req->authority, path, headers);
-                /* atm, we do not push on pushes */
-                h2_request_end_headers(req, ctx->pool, 1, 0);
-                push->req = req;
-                if (has_param(ctx, "critical")) {
-                    h2_priority *prio = apr_pcalloc(ctx->pool, sizeof(*prio));
-                    prio->dependency = H2_DEPENDANT_BEFORE;
-                    push->priority = prio;
-                }
-                if (!ctx->pushes) {
-                    ctx->pushes = apr_array_make(ctx->pool, 5, sizeof(h2_push*));
-                }
-                APR_ARRAY_PUSH(ctx->pushes, h2_push*) = push;
+                push_create(ctx, path, has_param(ctx, "critical"),
+                            push_url_hash(ctx->req->scheme, ctx->req->authority, path));
             }
         }
     }
@@ -424,16 +464,144 @@ static void inspect_link(link_ctx *ctx, const char *s, size_t slen)
      }
 }
 
+/* Pages send the same Link headers over and over. What a value yields
+ * for a scheme and authority is kept in a per child table, so that
+ * a repeated value is neither parsed nor hashed again. Values and
+ * results that do not fit a slot are parsed every time. */
+#define LINK_SLOTS          64
+#define LINK_VALUE_LEN      512
+#define LINK_AUTHORITY_LEN  128
+#define LINK_SCHEME_LEN     16
+#define LINK_PUSHES         8
+#define LINK_PATH_LEN       192
+
+typedef struct {
+    char path[LINK_PATH_LEN];       /* path to push */
+    int critical;                   /* if the link was marked critical */
+    apr_uint64_t url_hash;          /* FNV1A of the pushed url */
+} link_push;
+
+typedef struct {
+    apr_uint64_t key;               /* hash of value, scheme and authority, 0 if unused */
+    char value[LINK_VALUE_LEN];
+    char scheme[LINK_SCHEME_LEN];
+    char authority[LINK_AUTHORITY_LEN];
+    int npushes;
+    link_push pushes[LINK_PUSHES];
+} link_entry;
+
+static link_entry *link_entries;
+static apr_thread_mutex_t *link_lock;
+
+apr_status_t h2_push_links_child_init(apr_pool_t *pool, server_rec *s)
+{
+    server_rec *vs;
+
+    for (vs = s; vs; vs = vs->next) {
+        if (h2_config_sgeti(vs, H2_CONF_PUSH) > 0) {
+            link_entries = apr_pcalloc(pool, LINK_SLOTS * sizeof(link_entry));
+            return apr_thread_mutex_create(&link_lock,
+                                           APR_THREAD_MUTEX_DEFAULT, pool);
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static apr_uint64_t link_key(link_ctx *ctx, const char *value, size_t vlen)
+{
+    apr_uint64_t key = push_url_hash(ctx->req->scheme, ctx->req->authority, " ");
+
+    key = fnv1a_updaten(key, value, vlen);
+    return key? key : 1;
+}
+
+static int link_entry_is(link_entry *e, apr_uint64_t key, link_ctx *ctx,
+                         const char *value)
+{
+    return (e->key == key && !strcmp(e->value, value)
+            && !strcmp(e->scheme, ctx->req->scheme)
+            && !strcmp(e->authority, ctx->req->authority));
+}
+
+static int link_cache_get(link_ctx *ctx, const char *value, apr_uint64_t key)
+{
+    link_push pushes[LINK_PUSHES];
+    link_entry *e;
+    int i, n = -1;
+
+    apr_thread_mutex_lock(link_lock);
+    e = &link_entries[key % LINK_SLOTS];
+    if (link_entry_is(e, key, ctx, value)) {
+        n = e->npushes;
+        memcpy(pushes, e->pushes, n * sizeof(link_push));
+    }
+    apr_thread_mutex_unlock(link_lock);
+
+    for (i = 0; i < n; ++i) {
+        push_create(ctx, apr_pstrdup(ctx->pool, pushes[i].path),
+                    pushes[i].critical, pushes[i].url_hash);
+    }
+    return n >= 0;
+}
+
+static void link_cache_put(link_ctx *ctx, const char *value, apr_uint64_t key,
+                           int first)
+{
+    link_push pushes[LINK_PUSHES];
+    link_entry *e;
+    int i, n;
+
+    n = ctx->pushes? ctx->pushes->nelts - first : 0;
+    if (n > LINK_PUSHES
+        || strlen(ctx->req->scheme) >= LINK_SCHEME_LEN
+        || strlen(ctx->req->authority) >= LINK_AUTHORITY_LEN) {
+        return;
+    }
+    for (i = 0; i < n; ++i) {
+        h2_push *push = APR_ARRAY_IDX(ctx->pushes, first + i, h2_push*);
+        if (strlen(push->req->path) >= LINK_PATH_LEN) {
+            return;
+        }
+        apr_cpystrn(pushes[i].path, push->req->path, LINK_PATH_LEN);
+        pushes[i].critical = (push->priority != NULL);
+        pushes[i].url_hash = push->url_hash;
+    }
+
+    apr_thread_mutex_lock(link_lock);
+    e = &link_entries[key % LINK_SLOTS];
+    e->key = key;
+    apr_cpystrn(e->value, value, LINK_VALUE_LEN);
+    apr_cpystrn(e->scheme, ctx->req->scheme, LINK_SCHEME_LEN);
+    apr_cpystrn(e->authority, ctx->req->authority, LINK_AUTHORITY_LEN);
+    e->npushes = n;
+    memcpy(e->pushes, pushes, n * sizeof(link_push));
+    apr_thread_mutex_unlock(link_lock);
+}
+
 static int head_iter(void *ctx, const char *key, const char *value) 
 {
     if (!apr_strnatcasecmp("link", key)) {
-        inspect_link(ctx, value, strlen(value));
+        link_ctx *lctx = ctx;
+        size_t vlen = strlen(value);
+        apr_uint64_t lkey;
+        int first;
+
+        if (!link_entries || vlen >= LINK_VALUE_LEN) {
+            inspect_link(lctx, value, vlen);
+            return 1;
+        }
+        lkey = link_key(lctx, value, vlen);
+        if (!link_cache_get(lctx, value, lkey)) {
+            first = lctx->pushes? lctx->pushes->nelts : 0;
+            inspect_link(lctx, value, vlen);
+            link_cache_put(lctx, value, lkey, first);
+        }
     }
     return 1;
 }
 
 apr_array_header_t *h2_push_collect(apr_pool_t *p, const h2_request *req,
-                                    apr_uint32_t push_policy, const h2_headers *res)
+                                    apr_uint32_t push_policy, h2_headers *res)
 {
     if (req && push_policy != H2_PUSH_NONE) {
         /* Collect push candidates from the request/response pair.
@@ -452,10 +620,9 @@ apr_array_header_t *h2_push_collect(apr_pool_t *p, const h2_request *req,
             ctx.push_policy = push_policy;
             ctx.pool = p;
             
-            apr_table_do(head_iter, &ctx, res->headers, NULL);
+            h2_headers_do(res, head_iter, &ctx);
             if (ctx.pushes) {
-                apr_table_setn(res->headers, "push-policy", 
-                               policy_str(push_policy));
+                h2_headers_set_static(res, "push-policy", policy_str(push_policy));
             }
             return ctx.pushes;
         }
@@ -467,6 +634,9 @@ apr_array_header_t *h2_push_collect(apr_pool_t *p, const h2_request *req,
 
 typedef struct h2_push_diary_entry {
     apr_uint64_t hash;
+    int older;  /* next entry towards the oldest, -1 if none */
+    int newer;  /* next entry towards the newest, -1 if none */
+    int hnext;  /* next entry in the same hash bucket, -1 if none */
 } h2_push_diary_entry;
 
 
@@ -503,6 +673,16 @@ static void calc_sha256_hash(h2_push_diary *diary, apr_uint64_t *phash, h2_push
 #endif
 
 
+static void calc_fnv1a_hash(h2_push_diary *diary, apr_uint64_t *phash, h2_push *push)
+{
+    apr_uint64_t val = push->url_hash;
+
+    if (!val) {
+        val = push_url_hash(push->req->scheme, push->req->authority, push->req->path);
+    }
+    *phash = val >> (64 - diary->mask_bits);
+}
+
 static unsigned int val_apr_hash(const char *str) 
 {
     apr_ssize_t len = (apr_ssize_t)strlen(str);
@@ -553,8 +733,10 @@ static h2_push_diary *diary_create(apr_pool_t *p, h2_push_digest_type dtype,
          * If we set the diary via a compressed golomb set, we have less
          * relevant bits and need to use a smaller mask. */
         diary->mask_bits   = 64;
-        /* grows by doubling, start with a power of 2 */
-        diary->entries     = apr_array_make(p, 16, sizeof(h2_push_diary_entry));
+        /* entries are allocated on first use and grow by doubling */
+        diary->pool        = p;
+        diary->oldest      = -1;
+        diary->newest      = -1;
         
         switch (dtype) {
 #ifdef H2_OPENSSL
@@ -563,6 +745,10 @@ static h2_push_diary *diary_create(apr_pool_t *p, h2_push_digest_type dtype,
                 diary->dcalc       = calc_sha256_hash;
                 break;
 #endif /* ifdef H2_OPENSSL */
+            case H2_PUSH_DIGEST_FNV1A:
+                diary->dtype       = H2_PUSH_DIGEST_FNV1A;
+                diary->dcalc       = calc_fnv1a_hash;
+                break;
             default:
                 diary->dtype       = H2_PUSH_DIGEST_APR_HASH;
                 diary->dcalc       = calc_apr_hash;
@@ -575,19 +761,25 @@ static h2_push_diary *diary_create(apr_pool_t *p, h2_push_digest_type dtype,
 
 h2_push_diary *h2_push_diary_create(apr_pool_t *p, int N)
 {
-    return diary_create(p, H2_PUSH_DIGEST_SHA256, N);
+    /* The hashes are only compared in memory, a cheap one does */
+    return diary_create(p, H2_PUSH_DIGEST_FNV1A, N);
+}
+
+static int diary_bucket(h2_push_diary *diary, apr_uint64_t hash)
+{
+    /* 2*nalloc buckets, a power of 2 */
+    apr_uint32_t h = (apr_uint32_t)(hash ^ (hash >> 32)) * 0x9e3779b1u;
+    return (int)((h ^ (h >> 15)) & (apr_uint32_t)(2 * diary->nalloc - 1));
 }
 
 static int h2_push_diary_find(h2_push_diary *diary, apr_uint64_t hash)
 {
-    if (diary) {
-        h2_push_diary_entry *e;
+    if (diary && diary->nelts > 0) {
         int i;
 
-        /* search from the end, where the last accessed digests are */
-        for (i = diary->entries->nelts-1; i >= 0; --i) {
-            e = &APR_ARRAY_IDX(diary->entries, i, h2_push_diary_entry);
-            if (e->hash == hash) {
+        for (i = diary->buckets[diary_bucket(diary, hash)]; i >= 0;
+             i = diary->entries[i].hnext) {
+            if (diary->entries[i].hash == hash) {
                 return i;
             }
         }
@@ -595,55 +787,130 @@ static int h2_push_diary_find(h2_push_diary *diary, apr_uint64_t hash)
     return -1;
 }
 
-static void move_to_last(h2_push_diary *diary, apr_size_t idx)
+static void lru_unlink(h2_push_diary *diary, int idx)
 {
-    h2_push_diary_entry *entries = (h2_push_diary_entry*)diary->entries->elts;
-    h2_push_diary_entry e;
-    int lastidx;
-    
-    /* Move an existing entry to the last place */
-    if (diary->entries->nelts <= 0)
-        return;
+    h2_push_diary_entry *e = &diary->entries[idx];
 
-    /* move entry[idx] to the end */
-    lastidx = diary->entries->nelts - 1;
-    if (idx < lastidx) {
-        e =  entries[idx];
-        memmove(entries+idx, entries+idx+1, sizeof(h2_push_diary_entry) * (lastidx - idx));
-        entries[lastidx] = e;
+    if (e->older >= 0) {
+        diary->entries[e->older].newer = e->newer;
+    }
+    else {
+        diary->oldest = e->newer;
+    }
+    if (e->newer >= 0) {
+        diary->entries[e->newer].older = e->older;
+    }
+    else {
+        diary->newest = e->older;
     }
 }
 
-static void remove_first(h2_push_diary *diary)
+static void lru_link_newest(h2_push_diary *diary, int idx)
 {
-    h2_push_diary_entry *entries = (h2_push_diary_entry*)diary->entries->elts;
-    int lastidx;
-    
-    /* move remaining entries to index 0 */
-    lastidx = diary->entries->nelts - 1;
-    if (lastidx > 0) {
-        --diary->entries->nelts;
-        memmove(entries, entries+1, sizeof(h2_push_diary_entry) * diary->entries->nelts);
+    h2_push_diary_entry *e = &diary->entries[idx];
+
+    e->older = diary->newest;
+    e->newer = -1;
+    if (diary->newest >= 0) {
+        diary->entries[diary->newest].newer = idx;
+    }
+    else {
+        diary->oldest = idx;
+    }
+    diary->newest = idx;
+}
+
+static void move_to_last(h2_push_diary *diary, int idx)
+{
+    /* Move an existing entry to the most recently used place */
+    if (idx != diary->newest) {
+        lru_unlink(diary, idx);
+        lru_link_newest(diary, idx);
+    }
+}
+
+static void bucket_unlink(h2_push_diary *diary, int idx)
+{
+    int *pi = &diary->buckets[diary_bucket(diary, diary->entries[idx].hash)];
+
+    while (*pi >= 0) {
+        if (*pi == idx) {
+            *pi = diary->entries[idx].hnext;
+            return;
+        }
+        pi = &diary->entries[*pi].hnext;
     }
 }
 
-static void h2_push_diary_append(h2_push_diary *diary, h2_push_diary_entry *e)
+static void diary_grow(h2_push_diary *diary)
 {
-    while (diary->entries->nelts >= diary->N) {
-        remove_first(diary);
+    h2_push_diary_entry *entries;
+    int i, b, nalloc;
+
+    /* grows by doubling, start with a power of 2 */
+    nalloc = diary->nalloc? H2MIN(2 * diary->nalloc, diary->N) : H2MIN(16, diary->N);
+
+    entries = apr_palloc(diary->pool, sizeof(h2_push_diary_entry) * nalloc);
+    if (diary->nelts > 0) {
+        memcpy(entries, diary->entries, sizeof(h2_push_diary_entry) * diary->nelts);
+    }
+    diary->entries = entries;
+    diary->nalloc = nalloc;
+    diary->buckets = apr_palloc(diary->pool, sizeof(int) * 2 * nalloc);
+    memset(diary->buckets, 0xff, sizeof(int) * 2 * nalloc);
+    /* entry indices stay the same, only the chains need rebuilding */
+    for (i = 0; i < diary->nelts; ++i) {
+        b = diary_bucket(diary, entries[i].hash);
+        entries[i].hnext = diary->buckets[b];
+        diary->buckets[b] = i;
     }
-    /* append a new diary entry at the end */
-    APR_ARRAY_PUSH(diary->entries, h2_push_diary_entry) = *e;
+}
+
+static void h2_push_diary_append(h2_push_diary *diary, apr_uint64_t hash)
+{
+    h2_push_diary_entry *e;
+    int idx, b;
+
+    if (diary->nelts >= diary->N) {
+        /* forget the oldest entry and reuse its slot */
+        idx = diary->oldest;
+        bucket_unlink(diary, idx);
+        lru_unlink(diary, idx);
+    }
+    else {
+        if (diary->nelts >= diary->nalloc) {
+            diary_grow(diary);
+        }
+        idx = diary->nelts++;
+    }
+    e = &diary->entries[idx];
+    e->hash = hash;
+    b = diary_bucket(diary, hash);
+    e->hnext = diary->buckets[b];
+    diary->buckets[b] = idx;
+    lru_link_newest(diary, idx);
     /* Intentional no APLOGNO */
-    ap_log_perror(APLOG_MARK, GCSLOG_LEVEL, 0, diary->entries->pool,
-                  "push_diary_append: %"APR_UINT64_T_HEX_FMT, e->hash);
+    ap_log_perror(APLOG_MARK, GCSLOG_LEVEL, 0, diary->pool,
+                  "push_diary_append: %"APR_UINT64_T_HEX_FMT, hash);
+}
+
+int h2_push_diary_add(h2_push_diary *diary, apr_uint64_t hash)
+{
+    int idx = h2_push_diary_find(diary, hash);
+
+    if (idx >= 0) {
+        move_to_last(diary, idx);
+        return 0;
+    }
+    h2_push_diary_append(diary, hash);
+    return 1;
 }
 
 apr_array_header_t *h2_push_diary_update(h2_session *session, apr_array_header_t *pushes)
 {
     apr_array_header_t *npushes = pushes;
-    h2_push_diary_entry e;
-    int i, idx;
+    apr_uint64_t hash;
+    int i;
     
     if (session->push_diary && pushes) {
         npushes = NULL;
@@ -652,23 +919,20 @@ apr_array_header_t *h2_push_diary_update(h2_session *session, apr_array_header_t
             h2_push *push;
             
             push = APR_ARRAY_IDX(pushes, i, h2_push*);
-            session->push_diary->dcalc(session->push_diary, &e.hash, push);
-            idx = h2_push_diary_find(session->push_diary, e.hash);
-            if (idx >= 0) {
+            session->push_diary->dcalc(session->push_diary, &hash, push);
+            if (!h2_push_diary_add(session->push_diary, hash)) {
                 /* Intentional no APLOGNO */
                 ap_log_cerror(APLOG_MARK, GCSLOG_LEVEL, 0, session->c1,
                               "push_diary_update: already there PUSH %s", push->req->path);
-                move_to_last(session->push_diary, (apr_size_t)idx);
             }
             else {
                 /* Intentional no APLOGNO */
                 ap_log_cerror(APLOG_MARK, GCSLOG_LEVEL, 0, session->c1,
                               "push_diary_update: adding PUSH %s", push->req->path);
                 if (!npushes) {
-                    npushes = apr_array_make(pushes->pool, 5, sizeof(h2_push_diary_entry*));
+                    npushes = apr_array_make(pushes->pool, 5, sizeof(h2_push*));
                 }
                 APR_ARRAY_PUSH(npushes, h2_push*) = push;
-                h2_push_diary_append(session->push_diary, &e);
             }
         }
     }
@@ -677,7 +941,7 @@ apr_array_header_t *h2_push_diary_update(h2_session *session, apr_array_header_t
     
 apr_array_header_t *h2_push_collect_update(h2_stream *stream, 
                                            const struct h2_request *req, 
-                                           const struct h2_headers *res)
+                                           struct h2_headers *res)
 {
     apr_array_header_t *pushes;
     
@@ -798,7 +1062,7 @@ apr_status_t h2_push_diary_digest_get(h2_push_diary *diary, apr_pool_t *pool,
     apr_uint64_t *hashes;
     apr_size_t hash_count;
     
-    nelts = diary->entries->nelts;
+    nelts = diary->nelts;
     N = ceil_power_of_2(nelts);
     log2n = h2_log2(N);
     
@@ -836,11 +1100,10 @@ apr_status_t h2_push_diary_digest_get(h2_push_diary *diary, apr_pool_t *pool,
                   
     if (!authority || !diary->authority 
         || !strcmp("*", authority) || !strcmp(diary->authority, authority)) {
-        hash_count = diary->entries->nelts;
-        hashes = apr_pcalloc(encoder.pool, hash_count);
+        hash_count = diary->nelts;
+        hashes = apr_pcalloc(encoder.pool, hash_count * sizeof(apr_uint64_t));
         for (i = 0; i < hash_count; ++i) {
-            hashes[i] = ((&APR_ARRAY_IDX(diary->entries, i, h2_push_diary_entry))->hash 
-                         >> encoder.delta_bits);
+            hashes[i] = (diary->entries[i].hash >> encoder.delta_bits);
         }
         
         qsort(hashes, hash_count, sizeof(apr_uint64_t), cmp_puint64);
@@ -860,3 +1123,210 @@ apr_status_t h2_push_diary_digest_get(h2_push_diary *diary, apr_pool_t *pool,
     return APR_SUCCESS;
 }
 
+/*******************************************************************************
+ * learned preloads
+ ******************************************************************************/
+
+#define PRELOAD_SLOTS       256
+#define PRELOAD_RES         8
+#define PRELOAD_URI_LEN     192
+#define PRELOAD_WINDOW      apr_time_from_sec(2)
+#define PRELOAD_AGE_VIEWS   256
+
+typedef struct {
+    char uri[PRELOAD_URI_LEN];      /* path of the resource, empty if unused */
+    const char *as;                 /* the "as" of the preload link */
+    apr_uint32_t hits;              /* views of the page the resource was in */
+} preload_res;
+
+typedef struct {
+    apr_uint64_t key;               /* hash of authority and path, 0 if unused */
+    apr_uint32_t views;             /* views of the page counted */
+    preload_res res[PRELOAD_RES];
+} preload_page;
+
+static preload_page *preload_pages;
+static apr_thread_mutex_t *preload_lock;
+
+apr_status_t h2_push_learn_child_init(apr_pool_t *pool, server_rec *s)
+{
+    server_rec *vs;
+
+    for (vs = s; vs; vs = vs->next) {
+        if (h2_config_sgeti(vs, H2_CONF_EARLY_HINTS_LEARN) > 0) {
+            preload_pages = apr_pcalloc(pool, PRELOAD_SLOTS * sizeof(preload_page));
+            return apr_thread_mutex_create(&preload_lock,
+                                           APR_THREAD_MUTEX_DEFAULT, pool);
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static apr_uint64_t preload_page_key(apr_uint64_t authority, const char *path)
+{
+    /* the query does not make another page */
+    apr_uint64_t key = fnv1a_updaten(authority, path, strcspn(path, "?"));
+    return key? key : 1;
+}
+
+static const char *preload_as(h2_headers *response)
+{
+    /* Only what the server says the resource is, request headers like
+     * "sec-fetch-dest" are up to the client. */
+    const char *s = h2_headers_get(response, "content-type");
+
+    if (s) {
+        if (!strncasecmp("text/css", s, 8)) return "style";
+        if (ap_strcasestr(s, "javascript")) return "script";
+        if (!strncasecmp("font/", s, 5)) return "font";
+        if (!strncasecmp("image/", s, 6)) return "image";
+    }
+    return NULL;
+}
+
+static int preload_uri_ok(const char *path)
+{
+    /* The path goes into a Link header as is. Anything that could end
+     * the <uri> or start another parameter or link is not learned. */
+    const unsigned char *u = (const unsigned char *)path;
+
+    if (*u != '/') {
+        return 0;
+    }
+    for (; *u; ++u) {
+        if (*u <= ' ' || *u >= 0x7f || strchr("<>;,\"\\", *u)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void learn_page(h2_session *session, apr_uint64_t key,
+                       apr_uint64_t authority, apr_time_t now)
+{
+    preload_page *page = &preload_pages[key % PRELOAD_SLOTS];
+    int i;
+
+    apr_thread_mutex_lock(preload_lock);
+    if (page->key != key) {
+        /* the latest page takes the slot over */
+        memset(page, 0, sizeof(*page));
+        page->key = key;
+    }
+    if (++page->views >= PRELOAD_AGE_VIEWS) {
+        page->views /= 2;
+        for (i = 0; i < PRELOAD_RES; ++i) {
+            page->res[i].hits /= 2;
+        }
+    }
+    apr_thread_mutex_unlock(preload_lock);
+
+    session->learn_key = key;
+    session->learn_authority = authority;
+    session->learn_until = now + PRELOAD_WINDOW;
+}
+
+static void learn_res(h2_session *session, const char *path, const char *as)
+{
+    preload_page *page = &preload_pages[session->learn_key % PRELOAD_SLOTS];
+    preload_res *res;
+    int i, min = 0;
+
+    apr_thread_mutex_lock(preload_lock);
+    if (page->key == session->learn_key) {
+        for (i = 0; i < PRELOAD_RES; ++i) {
+            if (!strcmp(page->res[i].uri, path)) {
+                break;
+            }
+            if (page->res[i].hits < page->res[min].hits) {
+                min = i;
+            }
+        }
+        if (i < PRELOAD_RES) {
+            res = &page->res[i];
+        }
+        else {
+            /* Replace the least seen one. The newcomer inherits its count,
+             * so it needs to be seen as often to stay. */
+            res = &page->res[min];
+            apr_cpystrn(res->uri, path, sizeof(res->uri));
+            res->as = as;
+        }
+        if (res->hits < page->views) {
+            ++res->hits;
+        }
+    }
+    apr_thread_mutex_unlock(preload_lock);
+}
+
+void h2_push_learn(h2_stream *stream, h2_headers *response)
+{
+    h2_session *session = stream->session;
+    const h2_request *req = stream->request;
+    apr_uint64_t authority;
+    const char *s;
+    apr_time_t now;
+
+    if (!preload_pages || stream->initiated_on
+        || !req || !req->method || strcmp("GET", req->method)
+        || !req->authority || !req->path
+        || !h2_config_sgeti(session->s, H2_CONF_EARLY_HINTS_LEARN)) {
+        return;
+    }
+    now = apr_time_now();
+    authority = fnv1a_update(FNV1A_BASIS, req->authority);
+    s = h2_headers_get(response, "content-type");
+    if (response->status == 200 && s && !strncasecmp("text/html", s, 9)) {
+        learn_page(session, preload_page_key(authority, req->path), authority, now);
+    }
+    else if (now < session->learn_until
+             && authority == session->learn_authority
+             && (response->status == 200 || response->status == 304)
+             && strlen(req->path) < PRELOAD_URI_LEN
+             && preload_uri_ok(req->path)
+             && (s = preload_as(response))) {
+        learn_res(session, req->path, s);
+    }
+}
+
+int h2_push_learned_links(apr_table_t *headers, apr_pool_t *p,
+                          const h2_request *req)
+{
+    preload_page *page;
+    preload_res found[PRELOAD_RES], tmp;
+    apr_uint64_t key;
+    int i, j, n = 0;
+
+    if (!preload_pages || !req || !req->authority || !req->path) {
+        return 0;
+    }
+    key = preload_page_key(fnv1a_update(FNV1A_BASIS, req->authority), req->path);
+    page = &preload_pages[key % PRELOAD_SLOTS];
+
+    apr_thread_mutex_lock(preload_lock);
+    if (page->key == key && page->views >= 2) {
+        for (i = 0; i < PRELOAD_RES; ++i) {
+            if (page->res[i].uri[0] && page->res[i].hits * 2 >= page->views
+                && preload_uri_ok(page->res[i].uri)) {
+                found[n++] = page->res[i];
+            }
+        }
+    }
+    apr_thread_mutex_unlock(preload_lock);
+
+    /* most often seen first */
+    for (i = 1; i < n; ++i) {
+        for (j = i; j > 0 && found[j].hits > found[j-1].hits; --j) {
+            tmp = found[j];
+            found[j] = found[j-1];
+            found[j-1] = tmp;
+        }
+    }
+    for (i = 0; i < n; ++i) {
+        apr_table_add(headers, "Link",
+                      apr_psprintf(p, "<%s>; rel=preload; as=%s%s; nopush",
+                                   found[i].uri, found[i].as,
+                                   strcmp("font", found[i].as)? "" : "; crossorigin"));
+    }
+    return n;
+}
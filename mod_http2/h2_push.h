@@ -28,11 +28,13 @@ struct h2_stream;
 typedef struct h2_push {
     const struct h2_request *req;
     h2_priority *priority;
+    apr_uint64_t url_hash;      /* FNV1A of the pushed url, 0 if not known */
 } h2_push;
 
 typedef enum {
     H2_PUSH_DIGEST_APR_HASH,
-    H2_PUSH_DIGEST_SHA256
+    H2_PUSH_DIGEST_SHA256,
+    H2_PUSH_DIGEST_FNV1A
 } h2_push_digest_type;
 
 /*******************************************************************************
@@ -41,14 +43,15 @@ typedef enum {
  * - The push diary keeps track of resources already PUSHed via HTTP/2 on this
  *   connection. It records a hash value from the absolute URL of the resource
  *   pushed.
- * - Lacking openssl, 
- * - with openssl, it uses SHA256 to calculate the hash value, otherwise it
- *   falls back to apr_hashfunc_default()
+ * - The hash value is a 64 bit FNV-1a of the URL. It never leaves the
+ *   server, so there is no need for a cryptographic hash here.
  * - whatever the method to generate the hash, the diary keeps a maximum of 64
- *   bits per hash, limiting the memory consumption to about 
- *      H2PushDiarySize * 8 
- *   bytes. Entries are sorted by most recently used and oldest entries are
- *   forgotten first.
+ *   bits per hash, plus links and a hash index, limiting the memory
+ *   consumption to about
+ *      H2PushDiarySize * 32
+ *   bytes. Entries are linked by most recently used and oldest entries are
+ *   forgotten first. Lookup, refresh and eviction are O(1) via a hash
+ *   index into the entries.
  * - While useful by itself to avoid duplicated PUSHes on the same connection,
  *   the original idea was that clients provided a 'Cache-Digest' header with
  *   the values of *their own* cached resources. This was described in
@@ -77,8 +80,16 @@ typedef struct h2_push_diary h2_push_diary;
 
 typedef void h2_push_digest_calc(h2_push_diary *diary, apr_uint64_t *phash, h2_push *push);
 
+struct h2_push_diary_entry;
+
 struct h2_push_diary {
-    apr_array_header_t  *entries;
+    apr_pool_t          *pool;
+    struct h2_push_diary_entry *entries; /* nalloc slots, nelts in use */
+    int                 *buckets; /* 2*nalloc heads of hash chains, -1 if empty */
+    int         nelts;  /* number of entries in use */
+    int         nalloc; /* number of entries allocated, grows up to N */
+    int         oldest; /* least recently used entry, -1 if empty */
+    int         newest; /* most recently used entry, -1 if empty */
     int         NMax; /* Maximum for N, should size change be necessary */
     int         N;    /* Current maximum number of entries, power of 2 */
     apr_uint64_t         mask; /* mask for relevant bits */
@@ -100,7 +111,13 @@ struct h2_push_diary {
 apr_array_header_t *h2_push_collect(apr_pool_t *p, 
                                     const struct h2_request *req, 
                                     apr_uint32_t push_policy, 
-                                    const struct h2_headers *res);
+                                    struct h2_headers *res);
+
+/**
+ * Initialize the per child cache of parsed Link header values when a
+ * server has H2Push enabled.
+ */
+apr_status_t h2_push_links_child_init(apr_pool_t *pool, server_rec *s);
 
 /**
  * Create a new push diary for the given maximum number of entries.
@@ -111,6 +128,16 @@ apr_array_header_t *h2_push_collect(apr_pool_t *p,
  */
 h2_push_diary *h2_push_diary_create(apr_pool_t *p, int N);
 
+/**
+ * Enter the hash of a push into the diary. When the diary is full, the
+ * least recently used entry is forgotten.
+ * @param diary the diary
+ * @param hash the hash of the pushed resource
+ * @return 1 if the hash was entered, 0 if it was already in the diary
+ *         and only became the most recently used entry
+ */
+int h2_push_diary_add(h2_push_diary *diary, apr_uint64_t hash);
+
 /**
  * Filters the given pushes against the diary and returns only those pushes
  * that were newly entered in the diary.
@@ -123,7 +150,7 @@ apr_array_header_t *h2_push_diary_update(struct h2_session *session, apr_array_h
  */
 apr_array_header_t *h2_push_collect_update(struct h2_stream *stream, 
                                            const struct h2_request *req, 
-                                           const struct h2_headers *res);
+                                           struct h2_headers *res);
 /**
  * Get a cache digest as described in 
  * https://datatracker.ietf.org/doc/draft-kazuho-h2-cache-digest/
@@ -139,4 +166,40 @@ apr_status_t h2_push_diary_digest_get(h2_push_diary *diary, apr_pool_t *p,
                                       int maxP, const char *authority, 
                                       const char **pdata, apr_size_t *plen);
 
+/*******************************************************************************
+ * learned preloads
+ *
+ * - With H2EarlyHintsLearn, a HTML page answered on a connection opens a
+ *   short window in which the GET requests for styles, scripts, fonts and
+ *   images on the same connection are counted as its subresources.
+ * - Each child keeps a fixed table of such page manifests with a few
+ *   resources each. Pages hashing to the same slot take it over, counts
+ *   age so that resources a page no longer uses drop out.
+ * - Resources seen in at least half the views of a page are announced as
+ *   "rel=preload; nopush" links in a 103 response before its handler runs.
+ ******************************************************************************/
+
+/**
+ * Initialize the per child table of learned preloads when a server
+ * has H2EarlyHintsLearn enabled.
+ */
+apr_status_t h2_push_learn_child_init(apr_pool_t *pool, server_rec *s);
+
+/**
+ * Learn from the final response of a stream on c1.
+ * @param stream the stream answered
+ * @param response the final response headers
+ */
+void h2_push_learn(struct h2_stream *stream, struct h2_headers *response);
+
+/**
+ * Add the preloads learned for the page of a request as "Link" headers.
+ * @param headers the table to add the links to
+ * @param p the pool to allocate the links from
+ * @param req the request for the page
+ * @return the number of links added
+ */
+int h2_push_learned_links(apr_table_t *headers, apr_pool_t *p,
+                          const struct h2_request *req);
+
 #endif /* defined(__mod_h2__h2_push__) */
@@ -64,7 +64,7 @@ static int set_h1_header(void *ctx, const char *key, const char *value)
 {
     h1_ctx *x = ctx;
     int was_added;
-    h2_req_add_header(x->headers, x->pool, key, strlen(key), value, strlen(value), 0, &was_added);
+    h2_req_add_header(x->headers, x->pool, key, strlen(key), value, strlen(value), 0, 0, &was_added);
     return 1;
 }
 
@@ -106,6 +106,7 @@ apr_status_t h2_request_rcreate(h2_request **preq, apr_pool_t *pool,
     x.headers = req->headers;
     x.status = APR_SUCCESS;
     apr_table_do(set_h1_header, &x, r->headers_in, NULL);
+    h2_req_join_cookies(req->headers, pool);
     
     *preq = req;
     return x.status;
@@ -113,7 +114,7 @@ apr_status_t h2_request_rcreate(h2_request **preq, apr_pool_t *pool,
 
 apr_status_t h2_request_add_header(h2_request *req, apr_pool_t *pool, 
                                    const char *name, size_t nlen,
-                                   const char *value, size_t vlen,
+                                   const char *value, size_t vlen, int value_kept,
                                    size_t max_field_len, int *pwas_added)
 {
     apr_status_t status = APR_SUCCESS;
@@ -132,21 +133,24 @@ apr_status_t h2_request_add_header(h2_request *req, apr_pool_t *pool,
             return APR_EGENERAL;
         }
         
+        if (!value_kept) {
+            value = apr_pstrndup(pool, value, vlen);
+        }
         if (H2_HEADER_METHOD_LEN == nlen
             && !strncmp(H2_HEADER_METHOD, name, nlen)) {
-            req->method = apr_pstrndup(pool, value, vlen);
+            req->method = value;
         }
         else if (H2_HEADER_SCHEME_LEN == nlen
                  && !strncmp(H2_HEADER_SCHEME, name, nlen)) {
-            req->scheme = apr_pstrndup(pool, value, vlen);
+            req->scheme = value;
         }
         else if (H2_HEADER_PATH_LEN == nlen
                  && !strncmp(H2_HEADER_PATH, name, nlen)) {
-            req->path = apr_pstrndup(pool, value, vlen);
+            req->path = value;
         }
         else if (H2_HEADER_AUTH_LEN == nlen
                  && !strncmp(H2_HEADER_AUTH, name, nlen)) {
-            req->authority = apr_pstrndup(pool, value, vlen);
+            req->authority = value;
         }
         else {
             char buffer[32];
@@ -160,8 +164,8 @@ apr_status_t h2_request_add_header(h2_request *req, apr_pool_t *pool,
     }
     else {
         /* non-pseudo header, add to table */
-        status = h2_req_add_header(req->headers, pool, name, nlen, value, vlen, 
-                                   max_field_len, pwas_added);
+        status = h2_req_add_header(req->headers, pool, name, nlen, value, vlen,
+                                   value_kept, max_field_len, pwas_added);
     }
     
     return status;
@@ -207,6 +211,7 @@ apr_status_t h2_request_end_headers(h2_request *req, apr_pool_t *pool, int eos,
             apr_table_setn(req->headers, "Content-Length", "0");
         }
     }
+    h2_req_join_cookies(req->headers, pool);
     req->raw_bytes += raw_bytes;
 
     return APR_SUCCESS;
@@ -280,6 +285,28 @@ static request_rec *my_ap_create_request(conn_rec *c)
 }
 #endif
 
+request_rec *h2_request_config_rec(const h2_request *req, conn_rec *c)
+{
+#if AP_MODULE_MAGIC_AT_LEAST(20120211, 106)
+    request_rec *r = ap_create_request(c);
+#else
+    request_rec *r = my_ap_create_request(c);
+#endif
+
+    r->method = req->method;
+    r->method_number = ap_method_number_of(r->method);
+    r->headers_in = req->headers;
+    ap_parse_uri(r, req->path ? req->path : "");
+    /* as for the real request, the Host: header selects the server */
+    r->hostname = NULL;
+    ap_update_vhost_from_headers(r);
+    r->per_dir_config = r->server->lookup_defaults;
+    if (r->status == HTTP_OK && r->uri && r->uri[0] == '/') {
+        ap_location_walk(r);
+    }
+    return r;
+}
+
 request_rec *h2_create_request_rec(const h2_request *req, conn_rec *c)
 {
     int access_status = HTTP_OK;    
@@ -26,9 +26,14 @@ h2_request *h2_request_create(int id, apr_pool_t *pool, const char *method,
 apr_status_t h2_request_rcreate(h2_request **preq, apr_pool_t *pool,
                                 request_rec *r);
 
+/**
+ * Add a request header as received in HTTP/2.
+ * @param value_kept != 0 if value is NUL-terminated and lives as long
+ *                   as pool, it is then taken without copying
+ */
 apr_status_t h2_request_add_header(h2_request *req, apr_pool_t *pool,
                                    const char *name, size_t nlen,
-                                   const char *value, size_t vlen,
+                                   const char *value, size_t vlen, int value_kept,
                                    size_t max_field_len, int *pwas_added);
 
 apr_status_t h2_request_add_trailer(h2_request *req, apr_pool_t *pool,
@@ -49,5 +54,17 @@ h2_request *h2_request_clone(apr_pool_t *p, const h2_request *src);
  */
 request_rec *h2_create_request_rec(const h2_request *req, conn_rec *conn);
 
+/**
+ * Create a request_rec that only looks up the configuration for the
+ * h2_request: the virtual host its Host header selects and the
+ * <Location> sections matching its path. No hooks beyond create_request
+ * run and nothing is sent. The caller destroys r->pool when done.
+ *
+ * @param req the h2 request to look up
+ * @param conn the connection the request came in on
+ * @return the request_rec with server and per_dir_config resolved
+ */
+request_rec *h2_request_config_rec(const h2_request *req, conn_rec *conn);
+
 
 #endif /* defined(__mod_h2__h2_request__) */
@@ -17,7 +17,9 @@
 #include <assert.h>
 #include <stddef.h>
 #include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
 #include <apr_base64.h>
+#include <apr_hash.h>
 #include <apr_strings.h>
 
 #include <ap_mpm.h>
@@ -292,17 +294,14 @@ static int on_begin_headers_cb(nghttp2_session *ngh2,
     return s? 0 : NGHTTP2_ERR_START_STREAM_NOT_ALLOWED;
 }
 
-static int on_header_cb(nghttp2_session *ngh2, const nghttp2_frame *frame,
-                        const uint8_t *name, size_t namelen,
-                        const uint8_t *value, size_t valuelen,
-                        uint8_t flags,
-                        void *userp)
+static int add_header(h2_session *session, const nghttp2_frame *frame,
+                      const char *name, size_t namelen,
+                      const char *value, size_t valuelen,
+                      struct nghttp2_rcbuf *vbuf)
 {
-    h2_session *session = (h2_session *)userp;
     h2_stream * stream;
     apr_status_t status;
     
-    (void)flags;
     stream = get_stream(session, frame->hd.stream_id);
     if (!stream) {
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c1, APLOGNO(02920)
@@ -311,8 +310,8 @@ static int on_header_cb(nghttp2_session *ngh2, const nghttp2_frame *frame,
         return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
     }
     
-    status = h2_stream_add_header(stream, (const char *)name, namelen,
-                                  (const char *)value, valuelen);
+    session->hd_raw_in += namelen + valuelen;
+    status = h2_stream_add_header(stream, name, namelen, value, valuelen, vbuf);
     if (status != APR_SUCCESS
         && (!stream->rtmp
             || stream->rtmp->http_status == H2_HTTP_STATUS_UNSET)) {
@@ -321,6 +320,222 @@ static int on_header_cb(nghttp2_session *ngh2, const nghttp2_frame *frame,
     return 0;
 }
 
+#ifdef H2_NG2_RCBUF
+/* nghttp2 hands us the decoded name and value in reference counted
+ * buffers. Values that go into the request are held by the stream
+ * and not copied, which for fields from the HPACK table means no
+ * copy at all. Names are looked up or camel-cased anyway. */
+static int on_header_cb(nghttp2_session *ngh2, const nghttp2_frame *frame,
+                        nghttp2_rcbuf *nbuf, nghttp2_rcbuf *vbuf,
+                        uint8_t flags,
+                        void *userp)
+{
+    nghttp2_vec name = nghttp2_rcbuf_get_buf(nbuf);
+    nghttp2_vec value = nghttp2_rcbuf_get_buf(vbuf);
+    
+    (void)flags;
+    return add_header((h2_session *)userp, frame, 
+                      (const char *)name.base, name.len,
+                      (const char *)value.base, value.len, vbuf);
+}
+#else
+static int on_header_cb(nghttp2_session *ngh2, const nghttp2_frame *frame,
+                        const uint8_t *name, size_t namelen,
+                        const uint8_t *value, size_t valuelen,
+                        uint8_t flags,
+                        void *userp)
+{
+    (void)flags;
+    return add_header((h2_session *)userp, frame, 
+                      (const char *)name, namelen,
+                      (const char *)value, valuelen, NULL);
+}
+#endif
+
+#define CLIENT_LIMIT_SLOTS    1024
+
+typedef struct {
+    char ip[64];                /* client address or empty */
+    h2_tbucket tb;
+} client_limit;
+
+static client_limit *client_limits;
+static apr_thread_mutex_t *client_limits_lock;
+
+static apr_hash_t *live_sessions;
+static apr_thread_mutex_t *live_sessions_lock;
+static apr_uint64_t live_keys;
+
+static apr_status_t setup_child_init(apr_pool_t *pool, server_rec *s);
+
+apr_status_t h2_session_child_init(apr_pool_t *pool, server_rec *s)
+{
+    apr_pool_t *live_pool;
+    apr_status_t rv;
+
+    rv = setup_child_init(pool, s);
+    if (APR_SUCCESS != rv) return rv;
+    client_limits = apr_pcalloc(pool, CLIENT_LIMIT_SLOTS * sizeof(client_limit));
+    rv = apr_thread_mutex_create(&client_limits_lock,
+                                 APR_THREAD_MUTEX_DEFAULT, pool);
+    if (APR_SUCCESS != rv) return rv;
+    /* the hash allocates from its pool, only used under our lock */
+    rv = apr_pool_create(&live_pool, pool);
+    if (APR_SUCCESS != rv) return rv;
+    apr_pool_tag(live_pool, "h2_live_sessions");
+    live_sessions = apr_hash_make(live_pool);
+    return apr_thread_mutex_create(&live_sessions_lock,
+                                   APR_THREAD_MUTEX_DEFAULT, pool);
+}
+
+static void live_set(h2_session *session, int alive)
+{
+    if (!live_sessions) return;
+    apr_thread_mutex_lock(live_sessions_lock);
+    if (alive) {
+        session->live_key = ++live_keys;
+    }
+    apr_hash_set(live_sessions, &session->live_key, sizeof(session->live_key),
+                 alive? session : NULL);
+    apr_thread_mutex_unlock(live_sessions_lock);
+}
+
+void h2_session_live_do(h2_session_live_cb *cb, void *ctx)
+{
+    apr_hash_index_t *hi;
+    void *val;
+
+    if (!live_sessions) return;
+    apr_thread_mutex_lock(live_sessions_lock);
+    for (hi = apr_hash_first(NULL, live_sessions); hi; hi = apr_hash_next(hi)) {
+        apr_hash_this(hi, NULL, NULL, &val);
+        if (!cb(val, ctx)) break;
+    }
+    apr_thread_mutex_unlock(live_sessions_lock);
+}
+
+/**
+ * Take a control frame token of the client address. Addresses share
+ * a fixed table. When two hash to the same slot, the latest one
+ * takes it over with a bucket of its own. Unrelated clients must not
+ * share tokens and be sent away for each other's frames.
+ */
+static int take_client_ctrl_frame(const char *ip, int rate, apr_time_t now)
+{
+    client_limit *cl;
+    unsigned int h = 2166136261u;
+    const char *p;
+    int rv;
+
+    if (!client_limits || !ip) return 1;
+    for (p = ip; *p; ++p) {
+        h = (h ^ (unsigned char)*p) * 16777619u;
+    }
+    cl = &client_limits[h % CLIENT_LIMIT_SLOTS];
+    apr_thread_mutex_lock(client_limits_lock);
+    if (strcmp(cl->ip, ip)) {
+        apr_cpystrn(cl->ip, ip, sizeof(cl->ip));
+        h2_tbucket_init(&cl->tb, rate, now);
+    }
+    rv = h2_tbucket_take(&cl->tb, rate, rate, now);
+    apr_thread_mutex_unlock(client_limits_lock);
+    return rv;
+}
+
+/**
+ * Frames that do not carry request data and that a client could send
+ * in large numbers to keep us busy.
+ */
+static int is_ctrl_frame(h2_session *session, const nghttp2_frame *frame)
+{
+    switch (frame->hd.type) {
+        case NGHTTP2_PING:
+        case NGHTTP2_SETTINGS:
+            return !(frame->hd.flags & NGHTTP2_FLAG_ACK);
+        case NGHTTP2_PRIORITY:
+            return 1;
+        case NGHTTP2_WINDOW_UPDATE:
+            /* these are frequent while we send responses and a flow
+             * controlled stream waits for them. Only when no stream is
+             * open and nothing is pending, they are pure overhead. */
+            return session->state == H2_SESSION_ST_IDLE
+                && session->open_streams == 0
+                && !nghttp2_session_want_write(session->ngh2)
+                && !h2_c1_io_pending(&session->io);
+        case NGHTTP2_DATA:
+            return frame->hd.length == 0
+                && !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM);
+        default:
+            return 0;
+    }
+}
+
+static int take_ctrl_frame(h2_session *session)
+{
+    apr_time_t now;
+
+    if (!session->ctrl_frame_rate && !session->client_ctrl_frame_rate) {
+        return 1;
+    }
+    now = apr_time_now();
+    if (session->ctrl_frame_rate
+        && !h2_tbucket_take(&session->ctrl_frames, session->ctrl_frame_rate,
+                            session->ctrl_frame_rate, now)) {
+        return 0;
+    }
+    if (session->client_ctrl_frame_rate
+        && !take_client_ctrl_frame(session->c1->client_ip,
+                                   session->client_ctrl_frame_rate, now)) {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Account the HPACK encoded bytes of a header block, e.g. the frame
+ * payload without padding and priority/promised stream fields.
+ */
+static apr_off_t hd_block_len(const nghttp2_frame *frame)
+{
+    apr_off_t len = (apr_off_t)frame->hd.length;
+
+    switch (frame->hd.type) {
+        case NGHTTP2_HEADERS:
+            len -= (apr_off_t)frame->headers.padlen;
+            if (frame->hd.flags & NGHTTP2_FLAG_PRIORITY) {
+                len -= 5;
+            }
+            break;
+        case NGHTTP2_PUSH_PROMISE:
+            len -= (apr_off_t)frame->push_promise.padlen + 4;
+            break;
+        default:
+            return 0;
+    }
+    return H2MAX(len, 0);
+}
+
+static void hd_update_tables(h2_session *session)
+{
+#ifdef H2_NG2_HD_TABLE_SIZE
+    session->hd_table_in = nghttp2_session_get_hd_inflate_dynamic_table_size(session->ngh2);
+    session->hd_table_out = nghttp2_session_get_hd_deflate_dynamic_table_size(session->ngh2);
+#else
+    (void)session;
+#endif
+}
+
+static apr_size_t nv_len(const nghttp2_nv *nva, size_t nvlen)
+{
+    apr_size_t len = 0;
+    size_t i;
+
+    for (i = 0; i < nvlen; ++i) {
+        len += nva[i].namelen + nva[i].valuelen;
+    }
+    return len;
+}
+
 /**
  * nghttp2 session has received a complete frame. Most are used by nghttp2
  * for processing of internal state. Some, like HEADER and DATA frames,
@@ -334,6 +549,10 @@ static int on_frame_recv_cb(nghttp2_session *ng2s,
     h2_stream *stream;
     apr_status_t rv = APR_SUCCESS;
     
+    if (frame->hd.type == NGHTTP2_HEADERS) {
+        session->hd_wire_in += hd_block_len(frame);
+        hd_update_tables(session);
+    }
     stream = frame->hd.stream_id? get_stream(session, frame->hd.stream_id) : NULL;
     if (APLOGcdebug(session->c1)) {
         char buffer[256];
@@ -425,6 +644,19 @@ static int on_frame_recv_cb(nghttp2_session *ng2s,
             ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, session->c1,
                           H2_SSSN_MSG(session, "SETTINGS, len=%ld"), (long)frame->hd.length);
             break;
+        case NGHTTP2_PING:
+            if ((frame->hd.flags & NGHTTP2_FLAG_ACK) && session->ping_sent) {
+                /* answer to our RTT probe */
+                apr_interval_time_t rtt = apr_time_now() - session->ping_sent;
+                session->rtt = session->rtt? (7 * session->rtt + rtt) / 8 : rtt;
+                session->rtt_measured = apr_time_now();
+                session->ping_sent = 0;
+                session->ping_pending = 0;
+                ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, session->c1,
+                              H2_SSSN_MSG(session, "PING ACK, rtt=%ldus, srtt=%ldus"),
+                              (long)rtt, (long)session->rtt);
+            }
+            break;
         default:
             if (APLOGctrace2(session->c1)) {
                 char buffer[256];
@@ -437,35 +669,20 @@ static int on_frame_recv_cb(nghttp2_session *ng2s,
             break;
     }
     
-    if (session->state == H2_SESSION_ST_IDLE) {
-        /* We received a frame, but session is in state IDLE. That means the frame
-         * did not really progress any of the (possibly) open streams. It was a meta
-         * frame, e.g. SETTINGS/WINDOW_UPDATE/unknown/etc.
-         * Remember: IDLE means we cannot send because either there are no streams open or
-         * all open streams are blocked on exhausted WINDOWs for outgoing data.
-         * The more frames we receive that do not change this, the less interested we
-         * become in serving this connection. This is expressed in increasing "idle_delays".
-         * Eventually, the connection will timeout and we'll close it. */
-        session->idle_frames = H2MIN(session->idle_frames + 1, session->frames_received);
-            ap_log_cerror( APLOG_MARK, APLOG_TRACE2, 0, session->c1,
-                          H2_SSSN_MSG(session, "session has %ld idle frames"), 
-                          (long)session->idle_frames);
-        if (session->idle_frames > 10) {
-            apr_size_t busy_frames = H2MAX(session->frames_received - session->idle_frames, 1);
-            int idle_ratio = (int)(session->idle_frames / busy_frames); 
-            if (idle_ratio > 100) {
-                session->idle_delay = apr_time_from_msec(H2MIN(1000, idle_ratio));
-            }
-            else if (idle_ratio > 10) {
-                session->idle_delay = apr_time_from_msec(10);
-            }
-            else if (idle_ratio > 1) {
-                session->idle_delay = apr_time_from_msec(1);
-            }
-            else {
-                session->idle_delay = 0;
-            }
-        }
+    if (is_ctrl_frame(session, frame) && !take_ctrl_frame(session)) {
+        /* Frames that make no progress on any stream, but cost us work.
+         * Clients sending more than allowed are told to go away. */
+        ap_log_cerror(APLOG_MARK, APLOG_INFO, 0, session->c1,
+                      H2_SSSN_LOG(APLOGNO(10316), session,
+                      "control frame flood from %s, sending GOAWAY"),
+                      session->c1->client_ip);
+        session->local.accepting = 0;
+        session->local.shutdown = 1;
+        session->local.error = H2_ERR_ENHANCE_YOUR_CALM;
+        session->local.error_msg = "control frame flood";
+        session->local.accepted_max = h2_mplx_c1_shutdown(session->mplx);
+        nghttp2_session_terminate_session(ng2s, NGHTTP2_ENHANCE_YOUR_CALM);
+        return 0;
     }
     
     if (APR_SUCCESS != rv) return NGHTTP2_ERR_PROTO;
@@ -566,9 +783,18 @@ static int on_frame_send_cb(nghttp2_session *ngh2,
     
     ++session->frames_sent;
     switch (frame->hd.type) {
+        case NGHTTP2_HEADERS:
+            session->hd_raw_out += nv_len(frame->headers.nva, frame->headers.nvlen);
+            session->hd_wire_out += hd_block_len(frame);
+            hd_update_tables(session);
+            break;
         case NGHTTP2_PUSH_PROMISE:
             /* PUSH_PROMISE we report on the promised stream */
             stream_id = frame->push_promise.promised_stream_id;
+            session->hd_raw_out += nv_len(frame->push_promise.nva,
+                                          frame->push_promise.nvlen);
+            session->hd_wire_out += hd_block_len(frame);
+            hd_update_tables(session);
             break;
         default:    
             break;
@@ -595,6 +821,35 @@ static int on_frame_send_cb(nghttp2_session *ngh2,
         }
     }
     
+    switch (frame->hd.type) {
+        case NGHTTP2_PING:
+            if (!(frame->hd.flags & NGHTTP2_FLAG_ACK)) {
+                /* our RTT probe, measure from when it leaves */
+                session->ping_sent = apr_time_now();
+            }
+            session->io.flush_urgent = 1;
+            break;
+        case NGHTTP2_SETTINGS:
+            /* the peer waits on these */
+            if (frame->hd.flags & NGHTTP2_FLAG_ACK) {
+                session->io.flush_urgent = 1;
+            }
+            break;
+        case NGHTTP2_RST_STREAM:
+        case NGHTTP2_GOAWAY:
+            session->io.flush_urgent = 1;
+            break;
+        case NGHTTP2_HEADERS:
+        case NGHTTP2_DATA:
+            /* end of a response, the client is waiting for it */
+            if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM) {
+                session->io.flush_urgent = 1;
+            }
+            break;
+        default:
+            break;
+    }
+
     if (stream) {
         h2_stream_send_frame(stream, frame->hd.type, frame->hd.flags, 
             frame->hd.length + H2_FRAME_HDR_LEN);
@@ -659,13 +914,13 @@ static ssize_t select_padding_cb(nghttp2_session *ngh2,
 #define NGH2_SET_CALLBACK(callbacks, name, fn)\
 nghttp2_session_callbacks_set_##name##_callback(callbacks, fn)
 
-static apr_status_t init_callbacks(conn_rec *c, nghttp2_session_callbacks **pcb)
+static apr_status_t init_callbacks(server_rec *s, nghttp2_session_callbacks **pcb)
 {
     int rv = nghttp2_session_callbacks_new(pcb);
     if (rv != 0) {
-        ap_log_cerror(APLOG_MARK, APLOG_ERR, 0, c,
-                      APLOGNO(02926) "nghttp2_session_callbacks_new: %s",
-                      nghttp2_strerror(rv));
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, s,
+                     APLOGNO(02926) "nghttp2_session_callbacks_new: %s",
+                     nghttp2_strerror(rv));
         return APR_EGENERAL;
     }
     
@@ -675,7 +930,11 @@ static apr_status_t init_callbacks(conn_rec *c, nghttp2_session_callbacks **pcb)
     NGH2_SET_CALLBACK(*pcb, on_data_chunk_recv, on_data_chunk_recv_cb);
     NGH2_SET_CALLBACK(*pcb, on_stream_close, on_stream_close_cb);
     NGH2_SET_CALLBACK(*pcb, on_begin_headers, on_begin_headers_cb);
+#ifdef H2_NG2_RCBUF
+    nghttp2_session_callbacks_set_on_header_callback2(*pcb, on_header_cb);
+#else
     NGH2_SET_CALLBACK(*pcb, on_header, on_header_cb);
+#endif
     NGH2_SET_CALLBACK(*pcb, send_data, on_send_data_cb);
     NGH2_SET_CALLBACK(*pcb, on_frame_send, on_frame_send_cb);
 #ifdef H2_NG2_INVALID_HEADER_CB
@@ -685,6 +944,116 @@ static apr_status_t init_callbacks(conn_rec *c, nghttp2_session_callbacks **pcb)
     return APR_SUCCESS;
 }
 
+/**
+ * What a session needs from the server config to start: the nghttp2
+ * options and our initial SETTINGS. nghttp2 copies what it needs
+ * when a session is created, so one instance serves all sessions
+ * of a server, in all threads.
+ */
+typedef struct h2_session_setup {
+    nghttp2_option *options;
+    nghttp2_settings_entry settings[4];
+    size_t slen;
+    int win_size;
+} h2_session_setup;
+
+/* nghttp2 copies the callbacks into every new session */
+static nghttp2_session_callbacks *session_callbacks;
+/* server_rec* -> h2_session_setup*, read-only after child init */
+static apr_hash_t *session_setups;
+
+static apr_status_t setup_cleanup(void *data)
+{
+    h2_session_setup *setup = data;
+    
+    if (setup->options) {
+        nghttp2_option_del(setup->options);
+        setup->options = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t setup_create(h2_session_setup **psetup,
+                                 apr_pool_t *pool, server_rec *s)
+{
+    h2_session_setup *setup;
+    int rv, hd_table_size;
+    
+    *psetup = setup = apr_pcalloc(pool, sizeof(*setup));
+    rv = nghttp2_option_new(&setup->options);
+    if (rv != 0) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_EGENERAL, s,
+                     APLOGNO(02928) "nghttp2_option_new: %s", 
+                     nghttp2_strerror(rv));
+        return APR_ENOMEM;
+    }
+    apr_pool_cleanup_register(pool, setup, setup_cleanup, apr_pool_cleanup_null);
+    
+    nghttp2_option_set_peer_max_concurrent_streams(setup->options, 
+        (uint32_t)h2_config_sgeti(s, H2_CONF_MAX_STREAMS));
+    /* We need to handle window updates ourself, otherwise we
+     * get flooded by nghttp2. */
+    nghttp2_option_set_no_auto_window_update(setup->options, 1);
+#ifdef H2_NG2_DEFLATE_TABLE_SIZE
+    /* Limits the memory the encoder uses, even when clients allow more. */
+    nghttp2_option_set_max_deflate_dynamic_table_size(setup->options,
+        (size_t)h2_config_sgeti(s, H2_CONF_HPACK_ENCODE_SIZE));
+#endif
+#ifdef H2_NG2_NO_CLOSED_STREAMS
+    /* We do not want nghttp2 to keep information about closed streams as
+     * that accumulates memory on long connections. This makes PRIORITY
+     * setting in relation to older streams non-working. */
+    nghttp2_option_set_no_closed_streams(setup->options, 1);
+#endif
+
+    setup->slen = 0;
+    setup->settings[setup->slen].settings_id = NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    setup->settings[setup->slen].value = (uint32_t)h2_config_sgeti(s, H2_CONF_MAX_STREAMS);
+    ++setup->slen;
+    setup->win_size = h2_config_sgeti(s, H2_CONF_WIN_SIZE);
+    if (setup->win_size != H2_INITIAL_WINDOW_SIZE) {
+        setup->settings[setup->slen].settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
+        setup->settings[setup->slen].value = (uint32_t)setup->win_size;
+        ++setup->slen;
+    }
+    hd_table_size = h2_config_sgeti(s, H2_CONF_HPACK_DECODE_SIZE);
+    if (hd_table_size != H2_INITIAL_HEADER_TABLE_SIZE) {
+        setup->settings[setup->slen].settings_id = NGHTTP2_SETTINGS_HEADER_TABLE_SIZE;
+        setup->settings[setup->slen].value = (uint32_t)hd_table_size;
+        ++setup->slen;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t callbacks_cleanup(void *data)
+{
+    (void)data;
+    if (session_callbacks) {
+        nghttp2_session_callbacks_del(session_callbacks);
+        session_callbacks = NULL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t setup_child_init(apr_pool_t *pool, server_rec *s)
+{
+    h2_session_setup *setup;
+    server_rec *vs;
+    apr_status_t rv;
+    
+    rv = init_callbacks(s, &session_callbacks);
+    if (APR_SUCCESS != rv) return rv;
+    apr_pool_cleanup_register(pool, NULL, callbacks_cleanup, apr_pool_cleanup_null);
+    
+    session_setups = apr_hash_make(pool);
+    for (vs = s; vs; vs = vs->next) {
+        rv = setup_create(&setup, pool, vs);
+        if (APR_SUCCESS != rv) return rv;
+        apr_hash_set(session_setups, &vs, sizeof(vs), setup);
+    }
+    return APR_SUCCESS;
+}
+
 static void update_child_status(h2_session *session, int status,
                                 const char *msg, const h2_stream *stream)
 {
@@ -784,6 +1153,13 @@ static apr_status_t h2_session_shutdown(h2_session *session, int error,
     return status;
 }
 
+static int release_rcbufs_iter(void *ctx, void *val)
+{
+    (void)ctx;
+    h2_stream_release_rcbufs(val);
+    return 0;
+}
+
 static apr_status_t session_cleanup(h2_session *session, const char *trigger)
 {
     conn_rec *c = session->c1;
@@ -806,10 +1182,42 @@ static apr_status_t session_cleanup(h2_session *session, const char *trigger)
                       "goodbye, clients will be confused, should not happen"));
     }
 
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, c,
+                  H2_SSSN_MSG(session, "c1 io for %d streams: %ld reads "
+                  "(%ld without data), %ld passes, %ld flushes, %ld records, "
+                  "%ld direct writes with %ld iovecs"),
+                  (int)session->streams_done,
+                  (long)session->io.read_calls,
+                  (long)session->io.read_wouldblock,
+                  (long)session->io.pass_calls,
+                  (long)session->io.flush_calls,
+                  (long)session->io.records,
+                  (long)session->io.writev_calls,
+                  (long)session->io.writev_iovecs);
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, c,
+                  H2_SSSN_MSG(session, "HPACK in: %ld bytes as %ld, "
+                  "table %ld; out: %ld bytes as %ld, table %ld"),
+                  (long)session->hd_raw_in, (long)session->hd_wire_in,
+                  (long)session->hd_table_in,
+                  (long)session->hd_raw_out, (long)session->hd_wire_out,
+                  (long)session->hd_table_out);
+#ifdef H2_NG2_MEM
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, c,
+                  H2_SSSN_MSG(session, "nghttp2 memory: %ld allocs, %ld reused, "
+                  "%ld large, peak %ld bytes, pool %ld bytes"),
+                  (long)session->ngmem->allocs, (long)session->ngmem->reused,
+                  (long)session->ngmem->large, (long)session->ngmem->peak,
+                  (long)session->ngmem->arena);
+#endif
+    live_set(session, 0);
     transit(session, trigger, H2_SESSION_ST_CLEANUP);
     h2_mplx_c1_destroy(session->mplx);
     session->mplx = NULL;
 
+    /* Streams may outlive nghttp2, but not the header buffers they hold */
+    while (!h2_ihash_iter(session->rc_streams, release_rcbufs_iter, NULL)) {
+        /* until empty */
+    }
     ap_assert(session->ngh2);
     nghttp2_session_del(session->ngh2);
     session->ngh2 = NULL;
@@ -848,7 +1256,6 @@ apr_status_t h2_session_create(h2_session **psession, conn_rec *c, request_rec *
                                server_rec *s, h2_workers *workers)
 {
     nghttp2_session_callbacks *callbacks = NULL;
-    nghttp2_option *options = NULL;
     uint32_t n;
     apr_pool_t *pool = NULL;
     h2_session *session;
@@ -878,10 +1285,15 @@ apr_status_t h2_session_create(h2_session **psession, conn_rec *c, request_rec *
     
     session->max_stream_count = h2_config_sgeti(s, H2_CONF_MAX_STREAMS);
     session->max_stream_mem = h2_config_sgeti(s, H2_CONF_STREAM_MAX_MEM);
+    session->ctrl_frame_rate = h2_config_sgeti(s, H2_CONF_CTRL_FRAME_RATE);
+    session->client_ctrl_frame_rate = h2_config_sgeti(s, H2_CONF_CLIENT_CTRL_FRAME_RATE);
+    h2_tbucket_init(&session->ctrl_frames, session->ctrl_frame_rate, apr_time_now());
     
     session->in_pending = h2_iq_create(session->pool, (int)session->max_stream_count);
     session->out_c1_blocked = h2_iq_create(session->pool, (int)session->max_stream_count);
+    session->out_sock_blocked = h2_iq_create(session->pool, (int)session->max_stream_count);
     session->ready_to_process = h2_iq_create(session->pool, (int)session->max_stream_count);
+    session->rc_streams = h2_ihash_create(session->pool, offsetof(h2_stream, id));
 
     session->monitor = apr_pcalloc(pool, sizeof(h2_stream_monitor));
     session->monitor->ctx = session;
@@ -905,36 +1317,46 @@ apr_status_t h2_session_create(h2_session **psession, conn_rec *c, request_rec *
     session->padding_always = h2_config_sgeti(s, H2_CONF_PADDING_ALWAYS);
     session->bbtmp = apr_brigade_create(session->pool, c->bucket_alloc);
     
-    status = init_callbacks(c, &callbacks);
-    if (status != APR_SUCCESS) {
-        ap_log_cerror(APLOG_MARK, APLOG_ERR, status, c, APLOGNO(02927) 
-                      "nghttp2: error in init_callbacks");
-        apr_pool_destroy(pool);
-        return status;
+    if (session_setups) {
+        session->setup = apr_hash_get(session_setups, &s, sizeof(s));
+    }
+    if (!session->setup) {
+        /* not a server we saw at child init, build one for this session */
+        h2_session_setup *setup;
+        
+        status = setup_create(&setup, session->pool, s);
+        if (status != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            return status;
+        }
+        session->setup = setup;
     }
     
-    rv = nghttp2_option_new(&options);
-    if (rv != 0) {
-        ap_log_cerror(APLOG_MARK, APLOG_ERR, APR_EGENERAL, c,
-                      APLOGNO(02928) "nghttp2_option_new: %s", 
-                      nghttp2_strerror(rv));
-        apr_pool_destroy(pool);
-        return status;
+    callbacks = session_callbacks;
+    if (!callbacks) {
+        status = init_callbacks(s, &callbacks);
+        if (status != APR_SUCCESS) {
+            ap_log_cerror(APLOG_MARK, APLOG_ERR, status, c, APLOGNO(02927) 
+                          "nghttp2: error in init_callbacks");
+            apr_pool_destroy(pool);
+            return status;
+        }
     }
-    nghttp2_option_set_peer_max_concurrent_streams(options, (uint32_t)session->max_stream_count);
-    /* We need to handle window updates ourself, otherwise we
-     * get flooded by nghttp2. */
-    nghttp2_option_set_no_auto_window_update(options, 1);
-#ifdef H2_NG2_NO_CLOSED_STREAMS
-    /* We do not want nghttp2 to keep information about closed streams as
-     * that accumulates memory on long connections. This makes PRIORITY
-     * setting in relation to older streams non-working. */
-    nghttp2_option_set_no_closed_streams(options, 1);
-#endif
+    
+#ifdef H2_NG2_MEM
+    /* nghttp2 allocates from the session pool, not from the heap
+     * all c1 threads share, and is given back with it at once. */
+    session->ngmem = h2_ngmem_create(session->pool);
+    rv = nghttp2_session_server_new3(&session->ngh2, callbacks,
+                                     session, session->setup->options,
+                                     &session->ngmem->mem);
+#else
     rv = nghttp2_session_server_new2(&session->ngh2, callbacks,
-                                     session, options);
-    nghttp2_session_callbacks_del(callbacks);
-    nghttp2_option_del(options);
+                                     session, session->setup->options);
+#endif
+    if (callbacks != session_callbacks) {
+        nghttp2_session_callbacks_del(callbacks);
+    }
     
     if (rv != 0) {
         ap_log_cerror(APLOG_MARK, APLOG_ERR, APR_EGENERAL, c,
@@ -944,6 +1366,12 @@ apr_status_t h2_session_create(h2_session **psession, conn_rec *c, request_rec *
         return APR_ENOMEM;
     }
     
+    session->in_window_max = h2_config_sgeti(s, H2_CONF_WIN_SIZE_MAX);
+    if (session->in_window_max <= session->setup->win_size) {
+        /* nothing to grow into, windows stay as configured */
+        session->in_window_max = 0;
+    }
+    
     n = h2_config_sgeti(s, H2_CONF_PUSH_DIARY_SIZE);
     session->push_diary = h2_push_diary_create(session->pool, n);
     
@@ -962,16 +1390,34 @@ apr_status_t h2_session_create(h2_session **psession, conn_rec *c, request_rec *
     }
     
     apr_pool_pre_cleanup_register(pool, c, session_pool_cleanup);
+    live_set(session, 1);
         
     return APR_SUCCESS;
 }
 
+#define H2_RTT_PROBE_INTERVAL      apr_time_from_sec(2)
+
+void h2_session_rtt_probe(h2_session *session)
+{
+    apr_time_t now;
+    uint8_t opaque[8];
+    
+    if (session->ping_pending || session->local.shutdown) return;
+    now = apr_time_now();
+    if (session->rtt_measured 
+        && (now - session->rtt_measured) < H2_RTT_PROBE_INTERVAL) {
+        return;
+    }
+    memset(opaque, 0, sizeof(opaque));
+    memcpy(opaque, "h2rtt", 5);
+    if (!nghttp2_submit_ping(session->ngh2, NGHTTP2_FLAG_NONE, opaque)) {
+        session->ping_pending = 1;
+    }
+}
+
 static apr_status_t h2_session_start(h2_session *session, int *rv)
 {
     apr_status_t status = APR_SUCCESS;
-    nghttp2_settings_entry settings[3];
-    size_t slen;
-    int win_size;
     
     ap_assert(session);
     /* Start the conversation by submitting our SETTINGS frame */
@@ -1026,23 +1472,12 @@ static apr_status_t h2_session_start(h2_session *session, int *rv)
         }
     }
 
-    slen = 0;
-    settings[slen].settings_id = NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS;
-    settings[slen].value = (uint32_t)session->max_stream_count;
-    ++slen;
-    win_size = h2_config_sgeti(session->s, H2_CONF_WIN_SIZE);
-    if (win_size != H2_INITIAL_WINDOW_SIZE) {
-        settings[slen].settings_id = NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE;
-        settings[slen].value = win_size;
-        ++slen;
-    }
-    
     ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, session->c1,
                   H2_SSSN_LOG(APLOGNO(03201), session, 
                   "start, INITIAL_WINDOW_SIZE=%ld, MAX_CONCURRENT_STREAMS=%d"), 
-                  (long)win_size, (int)session->max_stream_count);
+                  (long)session->setup->win_size, (int)session->max_stream_count);
     *rv = nghttp2_submit_settings(session->ngh2, NGHTTP2_FLAG_NONE,
-                                  settings, slen);
+                                  session->setup->settings, session->setup->slen);
     if (*rv != 0) {
         status = APR_EGENERAL;
         ap_log_cerror(APLOG_MARK, APLOG_ERR, status, session->c1,
@@ -1060,7 +1495,7 @@ static apr_status_t h2_session_start(h2_session *session, int *rv)
          * in DATA flow.
          */
         *rv = nghttp2_submit_window_update(session->ngh2, NGHTTP2_FLAG_NONE,
-                                           0, NGHTTP2_MAX_WINDOW_SIZE - win_size);
+                                           0, NGHTTP2_MAX_WINDOW_SIZE - session->setup->win_size);
         if (*rv != 0) {
             status = APR_EGENERAL;
             ap_log_cerror(APLOG_MARK, APLOG_ERR, status, session->c1,
@@ -1225,8 +1660,10 @@ int h2_session_push_enabled(h2_session *session)
 
 static int h2_session_want_send(h2_session *session)
 {
+    /* output whose flush has been delayed does not count, the
+     * session will wait for its deadline instead. */
     return nghttp2_session_want_write(session->ngh2)
-        || h2_c1_io_pending(&session->io);
+        || (h2_c1_io_pending(&session->io) && !session->io.flush_due);
 }
 
 static apr_status_t h2_session_send(h2_session *session)
@@ -1640,6 +2077,9 @@ static void on_stream_event(void *ctx, h2_stream *stream, h2_stream_event_t ev)
         case H2_SEV_OUT_C1_BLOCK:
             h2_iq_append(session->out_c1_blocked, stream->id);
             break;
+        case H2_SEV_OUT_C1_SOCK_BLOCK:
+            h2_iq_append(session->out_sock_blocked, stream->id);
+            break;
         default:
             /* NOP */
             break;
@@ -1710,10 +2150,10 @@ void h2_session_dispatch_event(h2_session *session, h2_session_event_t ev,
     }
 }
 
-static void unblock_c1_out(h2_session *session) {
+static void unblock_c1_out(h2_session *session, h2_iqueue *blocked) {
     int sid;
 
-    while ((sid = h2_iq_shift(session->out_c1_blocked)) > 0) {
+    while ((sid = h2_iq_shift(blocked)) > 0) {
         nghttp2_session_resume_data(session->ngh2, sid);
     }
 }
@@ -1722,12 +2162,15 @@ apr_status_t h2_session_process(h2_session *session, int async)
 {
     apr_status_t status = APR_SUCCESS;
     conn_rec *c = session->c1;
-    int rv, mpm_state, trace = APLOGctrace3(c);
+    int rv, mpm_state, flush_wait, trace = APLOGctrace3(c);
+    apr_int64_t reads;
+    apr_interval_time_t timeout;
 
     if (trace) {
         ap_log_cerror( APLOG_MARK, APLOG_TRACE3, status, c,
                       H2_SSSN_MSG(session, "process start, async=%d"), async);
     }
+    session->suspended = 0;
 
     if (H2_SESSION_ST_INIT == session->state) {
         if (!h2_protocol_is_acceptable_c1(c, session->r, 1)) {
@@ -1794,7 +2237,7 @@ apr_status_t h2_session_process(h2_session *session, int async)
         }
 
         if (!h2_iq_empty(session->out_c1_blocked)) {
-            unblock_c1_out(session);
+            unblock_c1_out(session, session->out_c1_blocked);
             transit(session, "unblocked output", H2_SESSION_ST_BUSY);
         }
 
@@ -1807,7 +2250,7 @@ apr_status_t h2_session_process(h2_session *session, int async)
             h2_session_send(session);
         }
 
-        status = h2_c1_io_assure_flushed(&session->io);
+        status = h2_c1_io_schedule_flush(&session->io);
         if (APR_SUCCESS != status) {
             h2_session_dispatch_event(session, H2_SESSION_EV_CONN_ERROR, status, NULL);
         }
@@ -1822,6 +2265,12 @@ apr_status_t h2_session_process(h2_session *session, int async)
             ap_assert(session->open_streams == 0);
             ap_assert(nghttp2_session_want_read(session->ngh2));
             if (!h2_session_want_send(session)) {
+                /* Nothing to wait for, output must not be delayed */
+                status = h2_c1_io_assure_flushed(&session->io);
+                if (APR_SUCCESS != status) {
+                    h2_session_dispatch_event(session, H2_SESSION_EV_CONN_ERROR, status, NULL);
+                    break;
+                }
                 /* Give any new incoming request a short grace period to
                  * arrive while we are still hot and return to the mpm
                  * connection handling when nothing really happened. */
@@ -1842,27 +2291,85 @@ apr_status_t h2_session_process(h2_session *session, int async)
         case H2_SESSION_ST_BUSY:
             /* IO happening in and out. Make sure we react to c2 events
              * inbetween send and receive. */
+            reads = session->io.read_calls;
             status = h2_mplx_c1_poll(session->mplx, 0,
                                      on_stream_input, on_stream_output, session);
             if (APR_SUCCESS != status && !APR_STATUS_IS_TIMEUP(status)) {
                 h2_session_dispatch_event(session, H2_SESSION_EV_CONN_ERROR, status, NULL);
                 break;
             }
-            h2_c1_read(session);
+            if (reads == session->io.read_calls) {
+                /* c1 socket was not reported readable and read already,
+                 * we still need to look at what the filters hold. */
+                h2_c1_read(session);
+            }
             break;
 
         case H2_SESSION_ST_WAIT:
-            status = h2_c1_io_assure_flushed(&session->io);
+            if (!h2_iq_empty(session->out_sock_blocked)) {
+                /* Streams wait for the c1 socket to drain. Its poll
+                 * only reports that once the unsent data is below the
+                 * low watermark, c2 output has to wait that long anyway.
+                 * Resume the streams only when the socket is writable,
+                 * client input alone just gets read. */
+                status = h2_c1_io_wait_writable(&session->io, session->s->timeout);
+                if (APR_STATUS_IS_TIMEUP(status)) {
+                    h2_session_dispatch_event(session, H2_SESSION_EV_CONN_TIMEOUT, status, NULL);
+                }
+                else if (APR_SUCCESS != status) {
+                    h2_session_dispatch_event(session, H2_SESSION_EV_CONN_ERROR, status, NULL);
+                }
+                else if (!session->io.out_blocked) {
+                    unblock_c1_out(session, session->out_sock_blocked);
+                    transit(session, "c1 socket writable", H2_SESSION_ST_BUSY);
+                }
+                else {
+                    transit(session, "c1 input", H2_SESSION_ST_BUSY);
+                }
+                break;
+            }
+            if (async && session->suspendable && !session->io.flush_due
+                && h2_mplx_c1_can_suspend(session->mplx)) {
+                /* Only waiting on c2 output or c1 input. Free this thread
+                 * and let the MPM watch for both. */
+                status = h2_c1_io_assure_flushed(&session->io);
+                if (APR_SUCCESS != status) {
+                    h2_session_dispatch_event(session, H2_SESSION_EV_CONN_ERROR, status, NULL);
+                    break;
+                }
+                ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, c,
+                              H2_SSSN_MSG(session, "suspending, waiting on streams"));
+                session->suspended = 1;
+                goto leaving;
+            }
+            status = h2_c1_io_schedule_flush(&session->io);
             if (APR_SUCCESS != status) {
                 h2_session_dispatch_event(session, H2_SESSION_EV_CONN_ERROR, status, NULL);
                 break;
             }
             /* No IO happening and input is exhausted. Make sure we have
              * flushed any possibly pending output and then wait with
-             * the c1 connection timeout for sth to happen in our c1/c2 sockets/pipes */
-            status = h2_mplx_c1_poll(session->mplx, session->s->timeout,
+             * the c1 connection timeout for sth to happen in our c1/c2 sockets/pipes.
+             * A delayed flush shortens the wait to its deadline. */
+            timeout = session->s->timeout;
+            flush_wait = 0;
+            if (session->io.flush_due) {
+                apr_interval_time_t remain = session->io.flush_due - apr_time_now();
+                if (remain < timeout) {
+                    timeout = H2MAX(remain, 0);
+                    flush_wait = 1;
+                }
+            }
+            status = h2_mplx_c1_poll(session->mplx, timeout,
                                      on_stream_input, on_stream_output, session);
             if (APR_STATUS_IS_TIMEUP(status)) {
+                if (flush_wait) {
+                    status = h2_c1_io_assure_flushed(&session->io);
+                    if (APR_SUCCESS != status) {
+                        h2_session_dispatch_event(session, H2_SESSION_EV_CONN_ERROR, status, NULL);
+                    }
+                    break;
+                }
                 h2_session_dispatch_event(session, H2_SESSION_EV_CONN_TIMEOUT, status, NULL);
                 break;
             }
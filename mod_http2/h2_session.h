@@ -18,6 +18,7 @@
 #define __mod_h2__h2_session__
 
 #include "h2_c1_io.h"
+#include "h2_util.h"
 
 /**
  * A HTTP/2 connection, a session with a specific client.
@@ -36,6 +37,7 @@ struct h2_ctx;
 struct h2_config;
 struct h2_ihash_t;
 struct h2_mplx;
+struct h2_ngmem;
 struct h2_priority;
 struct h2_push;
 struct h2_push_diary;
@@ -69,6 +71,8 @@ typedef struct h2_session {
                                      * of 'h2c', NULL otherwise */
     server_rec *s;                  /* server/vhost we're starting on */
     apr_pool_t *pool;               /* pool to use in session */
+    apr_uint64_t live_key;          /* key among the live sessions of the
+                                     * child, connection ids get reused */
     struct h2_mplx *mplx;           /* multiplexer for stream data */
     struct h2_workers *workers;     /* for executing streams */
     struct h2_c1_io_in_ctx_t *cin;  /* connection input filter context */
@@ -76,6 +80,7 @@ typedef struct h2_session {
     int padding_max;                /* max number of padding bytes */
     int padding_always;             /* padding has precedence over I/O optimizations */
     struct nghttp2_session *ngh2;   /* the nghttp2 session (internal use) */
+    const struct h2_session_setup *setup; /* options and SETTINGS of server */
 
     h2_session_state state;         /* state session is in */
     
@@ -84,9 +89,14 @@ typedef struct h2_session {
     
     unsigned int reprioritize  : 1; /* scheduled streams priority changed */
     unsigned int flush         : 1; /* flushing output necessary */
+    unsigned int suspendable   : 1; /* MPM may watch c1 and streams for us */
+    unsigned int suspended     : 1; /* returned to have MPM watch c1 and streams */
     apr_interval_time_t  wait_us;   /* timeout during BUSY_WAIT state, micro secs */
     
     struct h2_push_diary *push_diary; /* remember pushes, avoid duplicates */
+    apr_uint64_t learn_key;         /* last HTML page answered, for learning preloads */
+    apr_uint64_t learn_authority;   /* authority of that page */
+    apr_time_t learn_until;         /* end of the window its subresources come in */
     
     struct h2_stream_monitor *monitor;/* monitor callbacks for streams */
     int open_streams;               /* number of streams processing */
@@ -100,12 +110,29 @@ typedef struct h2_session {
     
     apr_size_t frames_received;     /* number of http/2 frames received */
     apr_size_t frames_sent;         /* number of http/2 frames sent */
+
+    apr_off_t hd_raw_in;            /* request header bytes, decoded */
+    apr_off_t hd_wire_in;           /* request header block bytes, HPACK encoded */
+    apr_off_t hd_raw_out;           /* response header bytes, before encoding */
+    apr_off_t hd_wire_out;          /* response header block bytes, HPACK encoded */
+    apr_size_t hd_table_in;         /* HPACK decoder dynamic table in use */
+    apr_size_t hd_table_out;        /* HPACK encoder dynamic table in use */
+    struct h2_ngmem *ngmem;         /* nghttp2's allocator, NULL for malloc() */
     
     apr_size_t max_stream_count;    /* max number of open streams */
     apr_size_t max_stream_mem;      /* max buffer memory for a single stream */
     
-    apr_size_t idle_frames;         /* number of rcvd frames that kept session in idle state */
-    apr_interval_time_t idle_delay; /* Time we delay processing rcvd frames in idle state */
+    int in_window_max;              /* max stream receive window, 0 for static */
+    apr_off_t in_window_grown;      /* sum of stream window growth, <= in_window_max */
+    apr_off_t in_bdp;               /* largest bandwidth-delay product seen */
+    apr_interval_time_t rtt;        /* smoothed round trip time, 0 if unknown */
+    apr_time_t rtt_measured;        /* when rtt was last measured */
+    apr_time_t ping_sent;           /* when our RTT PING went out, 0 if none */
+    unsigned int ping_pending : 1;  /* RTT PING submitted, not ACKed yet */
+    
+    int ctrl_frame_rate;            /* control frames/s allowed, 0 for unlimited */
+    int client_ctrl_frame_rate;     /* control frames/s allowed per client address */
+    h2_tbucket ctrl_frames;         /* control frames the client may still send */
     
     apr_bucket_brigade *bbtmp;      /* brigade for keeping temporary data */
 
@@ -115,12 +142,31 @@ typedef struct h2_session {
     
     struct h2_iqueue *in_pending;   /* all streams with input pending */
     struct h2_iqueue *out_c1_blocked;  /* all streams with output blocked on c1 buffer full */
+    struct h2_iqueue *out_sock_blocked; /* all streams with output blocked on c1 socket full */
     struct h2_iqueue *ready_to_process;  /* all streams ready for processing */
+    struct h2_ihash_t *rc_streams;  /* all streams holding nghttp2 header buffers */
 
 } h2_session;
 
 const char *h2_session_state_str(h2_session_state state);
 
+/**
+ * Initialize the per child resources of sessions, e.g. the control
+ * frame limits of client addresses, the nghttp2 callbacks and the
+ * options and SETTINGS of each server.
+ */
+apr_status_t h2_session_child_init(apr_pool_t *pool, server_rec *s);
+
+typedef int h2_session_live_cb(h2_session *session, void *ctx);
+
+/**
+ * Invoke the callback on all live sessions of this child process until
+ * it returns 0. Sessions are not cleaned up while this runs, so the
+ * callback needs to be quick. It runs in another thread than the
+ * sessions and may only read their counters or ask their mplx.
+ */
+void h2_session_live_do(h2_session_live_cb *cb, void *ctx);
+
 /**
  * Create a new h2_session for the given connection.
  * The session will apply the configured parameter.
@@ -141,6 +187,10 @@ void h2_session_event(h2_session *session, h2_session_event_t ev,
 /**
  * Process the given HTTP/2 session until it is ended or a fatal
  * error occurred.
+ * With an async MPM and a `suspendable` session, processing also
+ * returns when only stream output or c1 input is awaited. The
+ * session is then `suspended` and the caller needs to have the
+ * MPM poll for it.
  *
  * @param session the sessionm to process
  */
@@ -151,6 +201,13 @@ apr_status_t h2_session_process(h2_session *session, int async);
  */
 apr_status_t h2_session_pre_close(h2_session *session, int async);
 
+/**
+ * Send a PING to measure the round trip time, unless one is on its
+ * way or the last measurement is recent.
+ * @param session the session to measure
+ */
+void h2_session_rtt_probe(h2_session *session);
+
 /**
  * Called when a serious error occurred and the session needs to terminate
  * without further connection io.
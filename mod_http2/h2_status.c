@@ -0,0 +1,168 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+ 
+#include <assert.h>
+
+#include <apr_strings.h>
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <httpd.h>
+#include <http_core.h>
+#include <http_config.h>
+#include <http_connection.h>
+#include <http_protocol.h>
+#include <http_request.h>
+#include <http_log.h>
+
+#include "h2_private.h"
+#include "h2.h"
+#include "h2_mplx.h"
+#include "h2_session.h"
+#include "h2_status.h"
+
+typedef struct {
+    long id;
+    const char *client;
+    const char *state;
+    int open_streams;
+    int streams_done;
+    long frames_received;
+    long frames_sent;
+    apr_off_t hd_raw_in, hd_wire_in, hd_raw_out, hd_wire_out;
+    long hd_table_in, hd_table_out;
+    h2_mplx_status ms;
+} session_status;
+
+typedef struct {
+    request_rec *r;
+    apr_array_header_t *sessions; /* of session_status */
+} status_ctx;
+
+static void add_stream(apr_bucket_brigade *bb, const h2_mplx_stream_status *ss,
+                       int first)
+{
+    apr_brigade_printf(bb, NULL, NULL,
+        "%s\n        {\"id\": %d, \"state\": \"%s\", "
+        "\"in_bytes\": %" APR_OFF_T_FMT ", \"out_bytes\": %" APR_OFF_T_FMT ", "
+        "\"in_buffered\": %" APR_OFF_T_FMT ", \"out_buffered\": %" APR_OFF_T_FMT ", "
+        "\"queued_us\": %" APR_TIME_T_FMT ", \"processing_us\": %" APR_TIME_T_FMT ", "
+        "\"done\": %s}",
+        first? "" : ",", ss->id, ss->state,
+        ss->in_data_octets, ss->out_data_octets,
+        ss->in_buffered, ss->out_buffered,
+        ss->queued, ss->processing, ss->done? "true" : "false");
+}
+
+static void add_session(apr_bucket_brigade *bb, const session_status *st,
+                        int first)
+{
+    const h2_mplx_status *ms = &st->ms;
+    int i;
+
+    apr_brigade_printf(bb, NULL, NULL,
+        "%s\n    {\"id\": %ld, \"client\": \"%s\", \"state\": \"%s\", "
+        "\"open_streams\": %d, \"streams_done\": %d, "
+        "\"frames_received\": %ld, \"frames_sent\": %ld, "
+        "\"processing_count\": %d, \"processing_limit\": %d, "
+        "\"processing_max\": %d, \"queued\": %d, "
+        "\"responses\": {\"native\": %d, \"h1\": %d}, "
+        "\"hpack\": {\"in_raw\": %" APR_OFF_T_FMT ", \"in_wire\": %" APR_OFF_T_FMT ", "
+        "\"in_table\": %ld, \"out_raw\": %" APR_OFF_T_FMT ", "
+        "\"out_wire\": %" APR_OFF_T_FMT ", \"out_table\": %ld}, "
+        "\"streams\": [",
+        first? "" : ",", st->id, st->client, st->state,
+        st->open_streams, st->streams_done,
+        st->frames_received, st->frames_sent,
+        ms->processing_count, ms->processing_limit, ms->processing_max,
+        ms->queued, ms->responses_native, ms->responses_h1,
+        st->hd_raw_in, st->hd_wire_in, st->hd_table_in,
+        st->hd_raw_out, st->hd_wire_out, st->hd_table_out);
+    for (i = 0; i < ms->streams->nelts; ++i) {
+        add_stream(bb, &APR_ARRAY_IDX(ms->streams, i, h2_mplx_stream_status), !i);
+    }
+    apr_brigade_puts(bb, NULL, NULL, "]}");
+}
+
+/* Runs under the lock of the live sessions, only copies numbers */
+static int copy_session(h2_session *session, void *ctx)
+{
+    status_ctx *x = ctx;
+    session_status *st;
+
+    if (!session->mplx) {
+        return 1;
+    }
+    st = apr_array_push(x->sessions);
+    if (APR_SUCCESS != h2_mplx_get_status(session->mplx, x->r->pool, &st->ms)) {
+        apr_array_pop(x->sessions);
+        return 1;
+    }
+    st->id = session->id;
+    st->client = apr_pstrdup(x->r->pool, session->c1->client_ip);
+    st->state = h2_session_state_str(session->state);
+    st->open_streams = session->open_streams;
+    st->streams_done = session->streams_done;
+    st->frames_received = (long)session->frames_received;
+    st->frames_sent = (long)session->frames_sent;
+    st->hd_raw_in = session->hd_raw_in;
+    st->hd_wire_in = session->hd_wire_in;
+    st->hd_table_in = (long)session->hd_table_in;
+    st->hd_raw_out = session->hd_raw_out;
+    st->hd_wire_out = session->hd_wire_out;
+    st->hd_table_out = (long)session->hd_table_out;
+    return 1;
+}
+
+static int h2_status_handler(request_rec *r)
+{
+    status_ctx x;
+    apr_bucket_brigade *bb;
+    apr_bucket *b;
+    int i;
+
+    if (!r->handler || strcmp(r->handler, "h2-status")) {
+        return DECLINED;
+    }
+    if (r->method_number != M_GET) {
+        return DECLINED;
+    }
+
+    ap_set_content_type(r, "application/json");
+    apr_table_setn(r->headers_out, "Cache-Control", "no-cache");
+    x.r = r;
+    x.sessions = apr_array_make(r->pool, 10, sizeof(session_status));
+    /* copy the numbers while the sessions are locked, format later */
+    h2_session_live_do(copy_session, &x);
+
+    bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    apr_brigade_printf(bb, NULL, NULL, "{\"pid\": %" APR_PID_T_FMT ", "
+                       "\"sessions\": [", getpid());
+    for (i = 0; i < x.sessions->nelts; ++i) {
+        add_session(bb, &APR_ARRAY_IDX(x.sessions, i, session_status), !i);
+    }
+    apr_brigade_puts(bb, NULL, NULL, "\n]}\n");
+    b = apr_bucket_eos_create(r->connection->bucket_alloc);
+    APR_BRIGADE_INSERT_TAIL(bb, b);
+    ap_pass_brigade(r->output_filters, bb);
+    return OK;
+}
+
+void h2_status_register_hooks(void)
+{
+    ap_hook_handler(h2_status_handler, NULL, NULL, APR_HOOK_MIDDLE);
+}
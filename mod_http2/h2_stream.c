@@ -178,6 +178,45 @@ static ssize_t stream_data_cb(nghttp2_session *ng2s,
                               nghttp2_data_source *source,
                               void *puser);
 
+/**
+ * Account for a bucket added at the end of out_buffer. We keep track
+ * of the data that can be sent before the next HEADERS or EOS and of
+ * the memory buffered, so that the DATA callback of nghttp2 does not
+ * have to look at the buckets.
+ */
+static void out_buffer_added(h2_stream *stream, apr_bucket *b)
+{
+    stream->out_buffer_mem += h2_bucket_mem_size(b);
+    if (stream->out_buffer_stop) return;
+    if (APR_BUCKET_IS_METADATA(b)) {
+        if (APR_BUCKET_IS_EOS(b) || H2_BUCKET_IS_HEADERS(b)) {
+            stream->out_buffer_stop = b;
+        }
+    }
+    else {
+        stream->out_buffer_data += (apr_off_t)b->length;
+    }
+}
+
+/**
+ * Count out_buffer anew, after HEADERS were taken out of it or it
+ * was cleaned up.
+ */
+static void out_buffer_recount(h2_stream *stream)
+{
+    apr_bucket *b;
+
+    stream->out_buffer_data = 0;
+    stream->out_buffer_mem = 0;
+    stream->out_buffer_stop = NULL;
+    if (!stream->out_buffer) return;
+    for (b = APR_BRIGADE_FIRST(stream->out_buffer);
+         b != APR_BRIGADE_SENTINEL(stream->out_buffer);
+         b = APR_BUCKET_NEXT(b)) {
+        out_buffer_added(stream, b);
+    }
+}
+
 static void H2_STREAM_OUT_LOG(int lvl, h2_stream *s, const char *tag)
 {
     if (APLOG_C_IS_LEVEL(s->session->c1, lvl)) {
@@ -330,6 +369,7 @@ static apr_status_t transit(h2_stream *stream, int new_state)
             close_input(stream);
             if (stream->out_buffer) {
                 apr_brigade_cleanup(stream->out_buffer);
+                out_buffer_recount(stream);
             }
             break;
         case H2_SS_CLEANUP:
@@ -555,7 +595,11 @@ void h2_stream_cleanup(h2_stream *stream)
     ap_assert(stream);
     if (stream->out_buffer) {
         apr_brigade_cleanup(stream->out_buffer);
+        out_buffer_recount(stream);
     }
+    /* give the window growth back to the session */
+    stream->session->in_window_grown -= stream->in_window_grown;
+    stream->in_window_grown = 0;
 }
 
 void h2_stream_destroy(h2_stream *stream)
@@ -625,8 +669,8 @@ static apr_status_t add_trailer(h2_stream *stream,
                                 size_t max_field_len, int *pwas_added)
 {
     conn_rec *c = stream->session->c1;
-    char *hname, *hvalue;
-    const char *existing;
+    const char *hname, *existing;
+    char *hvalue;
 
     *pwas_added = 0;
     if (nlen == 0 || name[0] == ':') {
@@ -641,8 +685,12 @@ static apr_status_t add_trailer(h2_stream *stream,
     if (!stream->trailers_in) {
         stream->trailers_in = apr_table_make(stream->pool, 5);
     }
-    hname = apr_pstrndup(stream->pool, name, nlen);
-    h2_util_camel_case_header(hname, nlen);
+    hname = h2_util_known_header(name, nlen);
+    if (!hname) {
+        char *s = apr_pstrndup(stream->pool, name, nlen);
+        h2_util_camel_case_header(s, nlen);
+        hname = s;
+    }
     existing = apr_table_get(stream->trailers_in, hname);
     if (max_field_len 
         && ((existing? strlen(existing)+2 : 0) + vlen + nlen + 2 > max_field_len)) {
@@ -658,9 +706,50 @@ static apr_status_t add_trailer(h2_stream *stream,
     return APR_SUCCESS;
 }
 
+#ifdef H2_NG2_RCBUF
+static apr_status_t rcbufs_cleanup(void *data)
+{
+    h2_stream_release_rcbufs(data);
+    return APR_SUCCESS;
+}
+
+static void hold_rcbuf(h2_stream *stream, nghttp2_rcbuf *vbuf)
+{
+    if (!stream->in_rcbufs) {
+        stream->in_rcbufs = apr_array_make(stream->pool, 10, sizeof(nghttp2_rcbuf*));
+        apr_pool_cleanup_register(stream->pool, stream, rcbufs_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+    if (!stream->in_rcbufs->nelts) {
+        h2_ihash_add(stream->session->rc_streams, stream);
+    }
+    /* HPACK table entries are shared this way, static ones ignore it */
+    nghttp2_rcbuf_incref(vbuf);
+    APR_ARRAY_PUSH(stream->in_rcbufs, nghttp2_rcbuf*) = vbuf;
+}
+#endif
+
+void h2_stream_release_rcbufs(h2_stream *stream)
+{
+#ifdef H2_NG2_RCBUF
+    int i;
+
+    if (stream->in_rcbufs && stream->in_rcbufs->nelts) {
+        for (i = 0; i < stream->in_rcbufs->nelts; ++i) {
+            nghttp2_rcbuf_decref(APR_ARRAY_IDX(stream->in_rcbufs, i, nghttp2_rcbuf*));
+        }
+        apr_array_clear(stream->in_rcbufs);
+        h2_ihash_remove(stream->session->rc_streams, stream->id);
+    }
+#else
+    (void)stream;
+#endif
+}
+
 apr_status_t h2_stream_add_header(h2_stream *stream,
                                   const char *name, size_t nlen,
-                                  const char *value, size_t vlen)
+                                  const char *value, size_t vlen,
+                                  struct nghttp2_rcbuf *vbuf)
 {
     h2_session *session = stream->session;
     int error = 0, was_added = 0;
@@ -695,8 +784,11 @@ apr_status_t h2_stream_add_header(h2_stream *stream,
                                              NULL, NULL, NULL, NULL, NULL);
         }
         status = h2_request_add_header(stream->rtmp, stream->pool,
-                                       name, nlen, value, vlen,
+                                       name, nlen, value, vlen, vbuf != NULL,
                                        session->s->limit_req_fieldsize, &was_added);
+#ifdef H2_NG2_RCBUF
+        if (vbuf && APR_SUCCESS == status) hold_rcbuf(stream, vbuf);
+#endif
         if (was_added) ++stream->request_headers_added;
     }
     else if (H2_SS_OPEN == stream->state) {
@@ -765,6 +857,73 @@ static int table_check_val_len(void *baton, const char *key, const char *value)
     return 0;
 }
 
+static int early_hints_servers;
+
+apr_status_t h2_stream_child_init(apr_pool_t *pool, server_rec *s)
+{
+    server_rec *vs;
+
+    (void)pool;
+    for (vs = s; vs; vs = vs->next) {
+        if (h2_config_sgeti(vs, H2_CONF_EARLY_HINTS) > 0) {
+            early_hints_servers = 1;
+            break;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+static void submit_early_hints(h2_stream *stream, h2_request *req)
+{
+    h2_session *session = stream->session;
+    apr_array_header_t *push_list;
+    request_rec *r;
+    h2_headers *headers;
+    h2_ngheader *nh;
+    int i, ngrv, n = 0;
+
+    /* With push enabled, the c2 sends the 103 as before, since its Link
+     * headers are what triggers the pushes. H2EarlyHints enabled only
+     * in a <Location> is also left to c2. */
+    if (!early_hints_servers || stream->initiated_on
+        || strcmp("GET", req->method)
+        || req->http_status != H2_HTTP_STATUS_UNSET
+        || apr_table_get(req->headers, "Expect")
+        || h2_session_push_enabled(session)) {
+        return;
+    }
+    /* The hints are those of the vhost and location the request
+     * goes to, not of the server the connection came in on. */
+    r = h2_request_config_rec(req, session->c1);
+    if (h2_config_rgeti(r, H2_CONF_EARLY_HINTS) <= 0) {
+        goto leave;
+    }
+    headers = h2_headers_create(103, NULL, NULL, 0, stream->pool);
+    push_list = h2_config_push_list(r);
+    for (i = 0; push_list && i < push_list->nelts; ++i) {
+        h2_push_res *push = &APR_ARRAY_IDX(push_list, i, h2_push_res);
+        apr_table_add(headers->headers, "Link",
+                      apr_psprintf(stream->pool, "<%s>; rel=preload%s",
+                                   push->uri_ref, push->critical? "; critical" : ""));
+        ++n;
+    }
+    if (h2_config_sgeti(r->server, H2_CONF_EARLY_HINTS_LEARN) > 0) {
+        n += h2_push_learned_links(headers->headers, stream->pool, req);
+    }
+    if (n <= 0 || h2_res_create_ngheader(&nh, stream->pool, headers) != APR_SUCCESS) {
+        goto leave;
+    }
+    ngrv = nghttp2_submit_headers(session->ngh2, NGHTTP2_FLAG_NONE, stream->id,
+                                  NULL, nh->nv, nh->nvlen, NULL);
+    if (!ngrv) {
+        req->early_hints_sent = 1;
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, session->c1,
+                      H2_STRM_MSG(stream, "early hints with %d links from c1"), n);
+    }
+leave:
+    apr_pool_destroy(r->pool);
+}
+
 apr_status_t h2_stream_end_headers(h2_stream *stream, int eos, size_t raw_bytes)
 {
     apr_status_t status;
@@ -790,6 +949,9 @@ apr_status_t h2_stream_end_headers(h2_stream *stream, int eos, size_t raw_bytes)
             /* keep on returning APR_SUCCESS, so that we send a HTTP response and
              * do not RST the stream. */
         }
+        else {
+            submit_early_hints(stream, stream->request);
+        }
     }
     return status;
 }
@@ -813,7 +975,7 @@ static apr_status_t buffer_output_receive(h2_stream *stream)
     apr_status_t rv = APR_EAGAIN;
     apr_off_t buf_len;
     conn_rec *c1 = stream->session->c1;
-    apr_bucket *b, *e;
+    apr_bucket *b;
 
     if (!stream->output) {
         goto cleanup;
@@ -821,14 +983,12 @@ static apr_status_t buffer_output_receive(h2_stream *stream)
 
     if (!stream->out_buffer) {
         stream->out_buffer = apr_brigade_create(stream->pool, c1->bucket_alloc);
-        buf_len = 0;
-    }
-    else {
-        /* if the brigade contains a file bucket, its normal report length
-         * might be megabytes, but the memory used is tiny. For buffering,
-         * we are only interested in the memory footprint. */
-        buf_len = h2_brigade_mem_size(stream->out_buffer);
+        stream->out_recv = apr_brigade_create(stream->pool, c1->bucket_alloc);
     }
+    /* if the brigade contains a file bucket, its normal report length
+     * might be megabytes, but the memory used is tiny. For buffering,
+     * we are only interested in the memory footprint. */
+    buf_len = stream->out_buffer_mem;
 
     if (buf_len >= stream->session->max_stream_mem) {
         /* we have buffered enough. No need to read more.
@@ -844,7 +1004,9 @@ static apr_status_t buffer_output_receive(h2_stream *stream)
     }
 
     H2_STREAM_OUT_LOG(APLOG_TRACE2, stream, "pre");
-    rv = h2_beam_receive(stream->output, stream->session->c1, stream->out_buffer,
+    /* receive separately, the beam may split or append to the last
+     * buckets of the brigade it is given. */
+    rv = h2_beam_receive(stream->output, stream->session->c1, stream->out_recv,
                          APR_NONBLOCK_READ, stream->session->max_stream_mem - buf_len);
     if (APR_SUCCESS != rv) {
         ap_log_cerror(APLOG_MARK, APLOG_TRACE1, rv, c1,
@@ -852,23 +1014,22 @@ static apr_status_t buffer_output_receive(h2_stream *stream)
         goto cleanup;
     }
 
-    /* get rid of buckets we have no need for */
-    if (!APR_BRIGADE_EMPTY(stream->out_buffer)) {
-        b = APR_BRIGADE_FIRST(stream->out_buffer);
-        while (b != APR_BRIGADE_SENTINEL(stream->out_buffer)) {
-            e = APR_BUCKET_NEXT(b);
-            if (APR_BUCKET_IS_METADATA(b)) {
-                if (APR_BUCKET_IS_FLUSH(b)) {  /* we flush any c1 data already */
-                    APR_BUCKET_REMOVE(b);
-                    apr_bucket_destroy(b);
-                }
-            }
-            else if (b->length == 0) {  /* zero length data */
-                APR_BUCKET_REMOVE(b);
+    /* get rid of buckets we have no need for, count the others */
+    while (!APR_BRIGADE_EMPTY(stream->out_recv)) {
+        b = APR_BRIGADE_FIRST(stream->out_recv);
+        APR_BUCKET_REMOVE(b);
+        if (APR_BUCKET_IS_METADATA(b)) {
+            if (APR_BUCKET_IS_FLUSH(b)) {  /* we flush any c1 data already */
                 apr_bucket_destroy(b);
+                continue;
             }
-            b = e;
         }
+        else if (b->length == 0) {  /* zero length data */
+            apr_bucket_destroy(b);
+            continue;
+        }
+        APR_BRIGADE_INSERT_TAIL(stream->out_buffer, b);
+        out_buffer_added(stream, b);
     }
     H2_STREAM_OUT_LOG(APLOG_TRACE2, stream, "out_buffer, after receive");
 
@@ -885,11 +1046,35 @@ apr_status_t h2_stream_read_to(h2_stream *stream, apr_bucket_brigade *bb,
                                apr_off_t *plen, int *peos)
 {
     apr_status_t rv = APR_SUCCESS;
+    apr_bucket *last, *b;
 
     if (stream->rst_error) {
         return APR_ECONNRESET;
     }
+    if (!stream->out_buffer) {
+        *plen = 0;
+        *peos = 0;
+        return APR_EAGAIN;
+    }
+    last = APR_BRIGADE_LAST(bb);
     rv = h2_append_brigade(bb, stream->out_buffer, plen, peos, bucket_pass_to_c1);
+    if (APR_SUCCESS != rv) {
+        out_buffer_recount(stream);
+        return rv;
+    }
+    /* only data moved, up to the next HEADERS or EOS */
+    stream->out_buffer_data -= *plen;
+    if (APR_BRIGADE_EMPTY(stream->out_buffer)) {
+        stream->out_buffer_mem = 0;
+    }
+    else {
+        /* a bucket split leaves one more bucket struct behind than
+         * we count, close enough until the buffer runs empty */
+        for (b = APR_BUCKET_NEXT(last); b != APR_BRIGADE_SENTINEL(bb);
+             b = APR_BUCKET_NEXT(b)) {
+            stream->out_buffer_mem -= h2_bucket_mem_size(b);
+        }
+    }
     if (APR_SUCCESS  == rv && !*peos && !*plen) {
         rv = APR_EAGAIN;
     }
@@ -915,6 +1100,7 @@ static apr_status_t buffer_output_process_headers(h2_stream *stream)
                 headers = h2_bucket_headers_get(b);
                 APR_BUCKET_REMOVE(b);
                 apr_bucket_destroy(b);
+                out_buffer_recount(stream);
                 ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, c1,
                               H2_STRM_MSG(stream, "process headers, response %d"),
                               headers->status);
@@ -1004,6 +1190,7 @@ static apr_status_t buffer_output_process_headers(h2_stream *stream)
         }
         if (h2_headers_are_final_response(headers)) {
             stream->response = headers;
+            h2_push_learn(stream, headers);
         }
 
         /* Do we know if this stream has no response body? */
@@ -1089,7 +1276,7 @@ const h2_priority *h2_stream_get_priority(h2_stream *stream,
                                           h2_headers *response)
 {
     if (response && stream->initiated_on) {
-        const char *ctype = apr_table_get(response->headers, "content-type");
+        const char *ctype = h2_headers_get(response, "content-type");
         if (ctype) {
             /* FIXME: Not good enough, config needs to come from request->server */
             return h2_cconfig_get_priority(stream->session->c1, ctype);
@@ -1120,63 +1307,98 @@ int h2_stream_was_closed(const h2_stream *stream)
     }
 }
 
+#ifdef H2_NG2_LOCAL_WIN_SIZE
+
+/* assumed round trip time until we measured one */
+#define H2_IN_WINDOW_RTT_DEFAULT   apr_time_from_msec(100)
+
+/**
+ * Grow the receive window of the stream toward the bandwidth-delay
+ * product. We measure how much the request consumes during one
+ * round trip. When that comes close to the window, the window is
+ * what limits the client and we offer twice the measured amount.
+ * Growth is bounded by H2MaxWindowSize, for all streams of a session
+ * together, as that is the data we may need to buffer.
+ */
+static void in_window_tune(h2_stream *stream)
+{
+    h2_session *session = stream->session;
+    apr_interval_time_t rtt, elapsed;
+    apr_off_t bdp, win, avail;
+    apr_time_t now;
+
+    if (!session->in_window_max) return;
+    now = apr_time_now();
+    if (!stream->in_round_start) {
+        stream->in_round_start = now;
+        stream->in_round_consumed = stream->in_consumed;
+        h2_session_rtt_probe(session);
+        /* start where earlier uploads on this connection got to */
+        bdp = session->in_bdp;
+        goto grow;
+    }
+    rtt = session->rtt? session->rtt : H2_IN_WINDOW_RTT_DEFAULT;
+    elapsed = now - stream->in_round_start;
+    if (elapsed < rtt) return;
+    
+    bdp = (stream->in_consumed - stream->in_round_consumed) * rtt / elapsed;
+    stream->in_round_start = now;
+    stream->in_round_consumed = stream->in_consumed;
+    h2_session_rtt_probe(session);
+    if (bdp > session->in_bdp) {
+        session->in_bdp = bdp;
+    }
+    if (2 * bdp <= stream->in_window_size) return;
+
+grow:
+    win = H2MIN(2 * bdp, session->in_window_max);
+    avail = session->in_window_max - session->in_window_grown;
+    win = H2MIN(win, stream->in_window_size + avail);
+    if (win > stream->in_window_size) {
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, session->c1,
+                      H2_STRM_MSG(stream, "window %d -> %ld, bdp=%ld, rtt=%ldus"),
+                      stream->in_window_size, (long)win, (long)bdp, 
+                      (long)session->rtt);
+        if (!nghttp2_session_set_local_window_size(session->ngh2, 
+                NGHTTP2_FLAG_NONE, stream->id, (int32_t)win)) {
+            session->in_window_grown += win - stream->in_window_size;
+            stream->in_window_grown += win - stream->in_window_size;
+            stream->in_window_size = (int)win;
+        }
+    }
+}
+
+#endif /* #ifdef H2_NG2_LOCAL_WIN_SIZE */
+
 apr_status_t h2_stream_in_consumed(h2_stream *stream, apr_off_t amount)
 {
     h2_session *session = stream->session;
     
     if (amount > 0) {
-        apr_off_t consumed = amount;
+        apr_off_t consumed;
         
+        stream->in_consumed += amount;
+        consumed = stream->in_consumed - stream->in_consumed_reported;
+        /* Report in steps of a quarter window, nghttp2 sends a
+         * WINDOW_UPDATE for every half window reported. Once all
+         * received data is consumed, the client may be waiting on
+         * us, so we report the rest. */
+        if (consumed < stream->in_window_size / 4
+            && stream->in_consumed < stream->in_data_octets) {
+            return APR_SUCCESS;
+        }
+        stream->in_consumed_reported = stream->in_consumed;
         while (consumed > 0) {
             int len = (consumed > INT_MAX)? INT_MAX : (int)consumed;
             nghttp2_session_consume(session->ngh2, stream->id, len);
             consumed -= len;
         }
-
 #ifdef H2_NG2_LOCAL_WIN_SIZE
-        if (1) {
-            int cur_size = nghttp2_session_get_stream_local_window_size(
-                session->ngh2, stream->id);
-            int win = stream->in_window_size;
-            int thigh = win * 8/10;
-            int tlow = win * 2/10;
-            const int win_max = 2*1024*1024;
-            const int win_min = 32*1024;
-            
-            /* Work in progress, probably should add directives for these
-             * values once this stabilizes somewhat. The general idea is
-             * to adapt stream window sizes if the input window changes
-             * a) very quickly (< good RTT) from full to empty
-             * b) only a little bit (> bad RTT)
-             * where in a) it grows and in b) it shrinks again.
-             */
-            if (cur_size > thigh && amount > thigh && win < win_max) {
-                /* almost empty again with one reported consumption, how
-                 * long did this take? */
-                long ms = apr_time_msec(apr_time_now() - stream->in_last_write);
-                if (ms < 40) {
-                    win = H2MIN(win_max, win + (64*1024));
-                }
-            }
-            else if (cur_size < tlow && amount < tlow && win > win_min) {
-                /* staying full, for how long already? */
-                long ms = apr_time_msec(apr_time_now() - stream->in_last_write);
-                if (ms > 700) {
-                    win = H2MAX(win_min, win - (32*1024));
-                }
-            }
-            
-            if (win != stream->in_window_size) {
-                stream->in_window_size = win;
-                nghttp2_session_set_local_window_size(session->ngh2, 
-                        NGHTTP2_FLAG_NONE, stream->id, win);
-            } 
-            ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, session->c1,
-                          "h2_stream(%ld-%d): consumed %ld bytes, window now %d/%d",
-                          session->id, stream->id, (long)amount, 
-                          cur_size, stream->in_window_size);
-        }
-#endif /* #ifdef H2_NG2_LOCAL_WIN_SIZE */
+        in_window_tune(stream);
+#endif
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, session->c1,
+                      H2_STRM_MSG(stream, "consumed %ld bytes, window %d"),
+                      (long)stream->in_consumed, stream->in_window_size);
     }
     return APR_SUCCESS;   
 }
@@ -1184,29 +1406,9 @@ apr_status_t h2_stream_in_consumed(h2_stream *stream, apr_off_t amount)
 static apr_off_t buffer_output_data_to_send(h2_stream *stream, int *peos)
 {
     /* How much data do we have in our buffers that we can write? */
-    apr_off_t buf_len = 0;
-    apr_bucket *b;
-
-    *peos = 0;
-    if (stream->out_buffer) {
-        b = APR_BRIGADE_FIRST(stream->out_buffer);
-        while (b != APR_BRIGADE_SENTINEL(stream->out_buffer)) {
-            if (APR_BUCKET_IS_METADATA(b)) {
-                if (APR_BUCKET_IS_EOS(b)) {
-                    *peos = 1;
-                    break;
-                }
-                else if (H2_BUCKET_IS_HEADERS(b)) {
-                    break;
-                }
-            }
-            else {
-                buf_len += b->length;
-            }
-            b = APR_BUCKET_NEXT(b);
-        }
-    }
-    return buf_len;
+    *peos = (stream->out_buffer_stop 
+             && APR_BUCKET_IS_EOS(stream->out_buffer_stop));
+    return stream->out_buffer_data;
 }
 
 static ssize_t stream_data_cb(nghttp2_session *ng2s,
@@ -1265,6 +1467,15 @@ static ssize_t stream_data_cb(nghttp2_session *ng2s,
         h2_stream_dispatch(stream, H2_SEV_OUT_C1_BLOCK);
         return NGHTTP2_ERR_DEFERRED;
     }
+    if (h2_c1_io_out_blocked(&session->io)) {
+        /* the socket has enough to send, keep DATA in our scheduler
+         * so that more important streams may overtake this one. */
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, c1,
+                      "h2_stream(%ld-%d): suspending on c1 socket unsent=%ld",
+                      session->id, (int)stream_id, (long)session->io.notsent);
+        h2_stream_dispatch(stream, H2_SEV_OUT_C1_SOCK_BLOCK);
+        return NGHTTP2_ERR_DEFERRED;
+    }
 
     /* determine how much we'd like to send. We cannot send more than
      * is requested. But we can reduce the size in case the master
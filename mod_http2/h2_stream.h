@@ -40,6 +40,7 @@ struct h2_request;
 struct h2_headers;
 struct h2_session;
 struct h2_bucket_beam;
+struct nghttp2_rcbuf;
 
 typedef struct h2_stream h2_stream;
 
@@ -74,6 +75,7 @@ struct h2_stream {
     struct h2_request *rtmp;    /* request being assembled */
     apr_table_t *trailers_in;   /* optional, incoming trailers */
     int request_headers_added;  /* number of request headers added */
+    apr_array_header_t *in_rcbufs; /* nghttp2 buffers request headers point into */
 
     struct h2_headers *response; /* the final, non-interim response or NULL */
 
@@ -81,9 +83,18 @@ struct h2_stream {
     apr_bucket_brigade *in_buffer;
     int in_window_size;
     apr_time_t in_last_write;
+    apr_off_t in_consumed;      /* # of DATA octets consumed by the request */
+    apr_off_t in_consumed_reported; /* # of consumed octets told to nghttp2 */
+    apr_time_t in_round_start;  /* start of current window measurement */
+    apr_off_t in_round_consumed; /* in_consumed at start of measurement */
+    apr_off_t in_window_grown;  /* window growth taken from session budget */
     
     struct h2_bucket_beam *output;
     apr_bucket_brigade *out_buffer;
+    apr_bucket_brigade *out_recv;   /* received, not yet added to out_buffer */
+    apr_off_t out_buffer_data;  /* data octets in out_buffer before out_buffer_stop */
+    apr_off_t out_buffer_mem;   /* memory footprint of out_buffer */
+    apr_bucket *out_buffer_stop; /* first HEADERS or EOS in out_buffer, or NULL */
 
     int rst_error;              /* stream error for RST_STREAM */
     unsigned int aborted   : 1; /* was aborted */
@@ -108,6 +119,12 @@ struct h2_stream {
 
 #define H2_STREAM_RST(s, def)    (s->rst_error? s->rst_error : (def))
 
+/**
+ * Note if any server has H2EarlyHints enabled, so that c1 looks up
+ * the hints for a request only when there may be some.
+ */
+apr_status_t h2_stream_child_init(apr_pool_t *pool, server_rec *s);
+
 /**
  * Create a stream in H2_SS_IDLE state.
  * @param id      the stream identifier
@@ -188,10 +205,21 @@ apr_status_t h2_stream_set_request_rec(h2_stream *stream,
  * @param nlen the number of characters in name
  * @param value the header value
  * @param vlen the number of characters in value
+ * @param vbuf the nghttp2 buffer holding value or NULL. If given, the
+ *             request takes value without copying and the stream holds
+ *             the buffer until it is destroyed.
  */
 apr_status_t h2_stream_add_header(h2_stream *stream,
                                   const char *name, size_t nlen,
-                                  const char *value, size_t vlen);
+                                  const char *value, size_t vlen,
+                                  struct nghttp2_rcbuf *vbuf);
+
+/**
+ * Give back the nghttp2 buffers the stream holds for its request
+ * headers. Their memory belongs to the session's nghttp2 instance and
+ * this has to happen before that goes away.
+ */
+void h2_stream_release_rcbufs(h2_stream *stream);
                                   
 /* End the construction of request headers */
 apr_status_t h2_stream_end_headers(h2_stream *stream, int eos, size_t raw_bytes);
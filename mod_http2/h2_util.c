@@ -15,6 +15,9 @@
  */
  
 #include <assert.h>
+#include <stdlib.h>
+#include <apr_atomic.h>
+#include <apr_lib.h>
 #include <apr_strings.h>
 #include <apr_thread_mutex.h>
 #include <apr_thread_cond.h>
@@ -1116,6 +1119,176 @@ apr_status_t h2_ififo_remove(h2_ififo *fifo, int id)
     return rv;
 }
 
+/*******************************************************************************
+ * token bucket
+ ******************************************************************************/
+
+void h2_tbucket_init(h2_tbucket *tb, int burst, apr_time_t now)
+{
+    tb->level = (apr_int64_t)burst * APR_USEC_PER_SEC;
+    tb->last = now;
+}
+
+int h2_tbucket_take(h2_tbucket *tb, int rate, int burst, apr_time_t now)
+{
+    apr_int64_t max = (apr_int64_t)burst * APR_USEC_PER_SEC;
+
+    if (now > tb->last) {
+        /* a full refill takes burst/rate secs, do not multiply beyond that */
+        apr_time_t elapsed = H2MIN(now - tb->last, apr_time_from_sec(3600));
+        tb->level = H2MIN(tb->level + elapsed * rate, max);
+        tb->last = now;
+    }
+    if (tb->level < APR_USEC_PER_SEC) {
+        return 0;
+    }
+    tb->level -= APR_USEC_PER_SEC;
+    return 1;
+}
+
+/*******************************************************************************
+ * nghttp2 memory
+ ******************************************************************************/
+#ifdef H2_NG2_MEM
+
+#define H2_NGMEM_MIN_SHIFT  5
+#define H2_NGMEM_CLASSES    (sizeof(((h2_ngmem *)0)->freelist)/sizeof(void*))
+#define H2_NGMEM_LARGE      ((apr_size_t)-1)
+
+/* In front of every allocation, keeps the pool's alignment */
+typedef union {
+    struct {
+        apr_size_t cls;         /* size class or H2_NGMEM_LARGE */
+        apr_size_t size;        /* size asked for */
+    } a;
+    void *next;                 /* when on a freelist */
+    char align[16];
+} ngmem_hdr;
+
+static apr_size_t ngmem_class(size_t size)
+{
+    apr_size_t cls = 0;
+    
+    while ((((size_t)1) << (cls + H2_NGMEM_MIN_SHIFT)) < size) {
+        if (++cls >= H2_NGMEM_CLASSES) {
+            return H2_NGMEM_LARGE;
+        }
+    }
+    return cls;
+}
+
+static void *ngmem_malloc(size_t size, void *mem_user_data)
+{
+    h2_ngmem *m = mem_user_data;
+    apr_size_t cls = ngmem_class(size);
+    ngmem_hdr *h;
+
+    if (cls == H2_NGMEM_LARGE) {
+        h = malloc(sizeof(*h) + size);
+        if (!h) {
+            return NULL;
+        }
+        ++m->large;
+    }
+    else if (m->freelist[cls]) {
+        h = m->freelist[cls];
+        m->freelist[cls] = h->next;
+        ++m->reused;
+    }
+    else {
+        apr_size_t len = sizeof(*h) + (((apr_size_t)1) << (cls + H2_NGMEM_MIN_SHIFT));
+        h = apr_palloc(m->pool, len);
+        m->arena += len;
+    }
+    h->a.cls = cls;
+    h->a.size = size;
+    ++m->allocs;
+    m->in_use += size;
+    if (m->in_use > m->peak) {
+        m->peak = m->in_use;
+    }
+    return h + 1;
+}
+
+static void ngmem_free(void *ptr, void *mem_user_data)
+{
+    h2_ngmem *m = mem_user_data;
+    ngmem_hdr *h;
+
+    if (!ptr) {
+        return;
+    }
+    h = ((ngmem_hdr *)ptr) - 1;
+    m->in_use -= h->a.size;
+    if (h->a.cls == H2_NGMEM_LARGE) {
+        free(h);
+    }
+    else {
+        apr_size_t cls = h->a.cls;
+        h->next = m->freelist[cls];
+        m->freelist[cls] = h;
+    }
+}
+
+static void *ngmem_calloc(size_t nmemb, size_t size, void *mem_user_data)
+{
+    void *ptr;
+
+    if (size && nmemb > ((size_t)-1) / size) {
+        return NULL;
+    }
+    ptr = ngmem_malloc(nmemb * size, mem_user_data);
+    if (ptr) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+static void *ngmem_realloc(void *ptr, size_t size, void *mem_user_data)
+{
+    h2_ngmem *m = mem_user_data;
+    ngmem_hdr *h;
+    void *nptr;
+
+    if (!ptr) {
+        return ngmem_malloc(size, mem_user_data);
+    }
+    if (!size) {
+        ngmem_free(ptr, mem_user_data);
+        return NULL;
+    }
+    h = ((ngmem_hdr *)ptr) - 1;
+    if (h->a.cls != H2_NGMEM_LARGE && h->a.cls == ngmem_class(size)) {
+        /* still fits */
+        m->in_use = m->in_use - h->a.size + size;
+        if (m->in_use > m->peak) {
+            m->peak = m->in_use;
+        }
+        h->a.size = size;
+        return ptr;
+    }
+    nptr = ngmem_malloc(size, mem_user_data);
+    if (nptr) {
+        memcpy(nptr, ptr, H2MIN(h->a.size, size));
+        ngmem_free(ptr, mem_user_data);
+    }
+    return nptr;
+}
+
+h2_ngmem *h2_ngmem_create(apr_pool_t *pool)
+{
+    h2_ngmem *m = apr_pcalloc(pool, sizeof(*m));
+
+    m->pool = pool;
+    m->mem.mem_user_data = m;
+    m->mem.malloc = ngmem_malloc;
+    m->mem.free = ngmem_free;
+    m->mem.calloc = ngmem_calloc;
+    m->mem.realloc = ngmem_realloc;
+    return m;
+}
+#endif /* H2_NG2_MEM */
+
 /*******************************************************************************
  * h2_util for apt_table_t
  ******************************************************************************/
@@ -1452,6 +1625,19 @@ leave:
     return APR_SUCCESS;
 }
 
+apr_off_t h2_bucket_mem_size(apr_bucket *b)
+{
+    apr_off_t total = sizeof(*b);
+    
+    if (b->length > 0) {
+        if (APR_BUCKET_IS_HEAP(b)
+            || APR_BUCKET_IS_POOL(b)) {
+            total += b->length;
+        }
+    }
+    return total;
+}
+
 apr_off_t h2_brigade_mem_size(apr_bucket_brigade *bb)
 {
     apr_bucket *b;
@@ -1461,13 +1647,7 @@ apr_off_t h2_brigade_mem_size(apr_bucket_brigade *bb)
          b != APR_BRIGADE_SENTINEL(bb);
          b = APR_BUCKET_NEXT(b))
     {
-        total += sizeof(*b);
-        if (b->length > 0) {
-            if (APR_BUCKET_IS_HEAP(b)
-                || APR_BUCKET_IS_POOL(b)) {
-                total += b->length;
-            }
-        }
+        total += h2_bucket_mem_size(b);
     }
     return total;
 }
@@ -1477,14 +1657,176 @@ apr_off_t h2_brigade_mem_size(apr_bucket_brigade *bb)
  * h2_ngheader
  ******************************************************************************/
  
+/* Header names we see all the time. They are placed into a table
+ * by a perfect hash over their lower-cased names, so a lookup is
+ * one hash and one compare. The canonical spelling is what
+ * h2_util_camel_case_header() produces and it is added to request
+ * headers without copying. The lower-cased name goes into HTTP/2
+ * responses the same way.
+ * A new name needs the slot that known_hash() gives it. The
+ * multiplier was chosen so that all names here get different slots,
+ * and test_h2_util checks that this stays true. */
+#define H2_KH_IGNORE    0x01    /* not taken from a request */
+#define H2_KH_HOP       0x02    /* never forwarded, ch. 8.1.2.2 */
+#define H2_KH_COOKIE    0x04
+#define H2_KH_HOST      0x08
+
+typedef struct {
+    const char *lname;
+    size_t len;
+    const char *name;
+    int flags;
+} known_header;
+
+#define H2_DEF_KNOWN(n, c, f)   { (n), (sizeof(n)-1), (c), (f) }
+#define H2_KH_SLOTS             256
+
+static const known_header KnownHeaders[H2_KH_SLOTS] = {
+    [252] = H2_DEF_KNOWN("accept", "Accept", 0),
+    [100] = H2_DEF_KNOWN("accept-charset", "Accept-Charset", 0),
+    [ 62] = H2_DEF_KNOWN("accept-encoding", "Accept-Encoding", 0),
+    [ 80] = H2_DEF_KNOWN("accept-language", "Accept-Language", 0),
+    [185] = H2_DEF_KNOWN("accept-ranges", "Accept-Ranges", 0),
+    [ 69] = H2_DEF_KNOWN("access-control-allow-credentials",
+                         "Access-Control-Allow-Credentials", 0),
+    [239] = H2_DEF_KNOWN("access-control-allow-headers",
+                         "Access-Control-Allow-Headers", 0),
+    [158] = H2_DEF_KNOWN("access-control-allow-methods",
+                         "Access-Control-Allow-Methods", 0),
+    [224] = H2_DEF_KNOWN("access-control-allow-origin",
+                         "Access-Control-Allow-Origin", 0),
+    [  5] = H2_DEF_KNOWN("access-control-expose-headers",
+                         "Access-Control-Expose-Headers", 0),
+    [ 52] = H2_DEF_KNOWN("access-control-max-age",
+                         "Access-Control-Max-Age", 0),
+    [215] = H2_DEF_KNOWN("access-control-request-headers",
+                         "Access-Control-Request-Headers", 0),
+    [104] = H2_DEF_KNOWN("access-control-request-method",
+                         "Access-Control-Request-Method", 0),
+    [ 92] = H2_DEF_KNOWN("age", "Age", 0),
+    [ 21] = H2_DEF_KNOWN("allow", "Allow", 0),
+    [111] = H2_DEF_KNOWN("alt-svc", "Alt-Svc", 0),
+    [ 85] = H2_DEF_KNOWN("authorization", "Authorization", 0),
+    [152] = H2_DEF_KNOWN("cache-control", "Cache-Control", 0),
+    [212] = H2_DEF_KNOWN("connection", "Connection", H2_KH_IGNORE|H2_KH_HOP),
+    [120] = H2_DEF_KNOWN("content-disposition", "Content-Disposition", 0),
+    [ 66] = H2_DEF_KNOWN("content-encoding", "Content-Encoding", 0),
+    [ 83] = H2_DEF_KNOWN("content-language", "Content-Language", 0),
+    [ 28] = H2_DEF_KNOWN("content-length", "Content-Length", 0),
+    [192] = H2_DEF_KNOWN("content-location", "Content-Location", 0),
+    [ 71] = H2_DEF_KNOWN("content-range", "Content-Range", 0),
+    [ 40] = H2_DEF_KNOWN("content-security-policy",
+                         "Content-Security-Policy", 0),
+    [114] = H2_DEF_KNOWN("content-type", "Content-Type", 0),
+    [ 41] = H2_DEF_KNOWN("cookie", "Cookie", H2_KH_COOKIE),
+    [178] = H2_DEF_KNOWN("cross-origin-opener-policy",
+                         "Cross-Origin-Opener-Policy", 0),
+    [169] = H2_DEF_KNOWN("cross-origin-resource-policy",
+                         "Cross-Origin-Resource-Policy", 0),
+    [207] = H2_DEF_KNOWN("date", "Date", 0),
+    [140] = H2_DEF_KNOWN("dnt", "Dnt", 0),
+    [204] = H2_DEF_KNOWN("early-data", "Early-Data", 0),
+    [ 86] = H2_DEF_KNOWN("etag", "Etag", 0),
+    [179] = H2_DEF_KNOWN("expect", "Expect", 0),
+    [ 51] = H2_DEF_KNOWN("expires", "Expires", 0),
+    [154] = H2_DEF_KNOWN("forwarded", "Forwarded", 0),
+    [ 37] = H2_DEF_KNOWN("from", "From", 0),
+    [103] = H2_DEF_KNOWN("host", "Host", H2_KH_HOST),
+    [250] = H2_DEF_KNOWN("http2-settings", "Http2-Settings", H2_KH_IGNORE),
+    [171] = H2_DEF_KNOWN("if-match", "If-Match", 0),
+    [238] = H2_DEF_KNOWN("if-modified-since", "If-Modified-Since", 0),
+    [174] = H2_DEF_KNOWN("if-none-match", "If-None-Match", 0),
+    [ 98] = H2_DEF_KNOWN("if-range", "If-Range", 0),
+    [ 99] = H2_DEF_KNOWN("if-unmodified-since", "If-Unmodified-Since", 0),
+    [ 44] = H2_DEF_KNOWN("keep-alive", "Keep-Alive", H2_KH_IGNORE|H2_KH_HOP),
+    [  6] = H2_DEF_KNOWN("last-modified", "Last-Modified", 0),
+    [156] = H2_DEF_KNOWN("link", "Link", 0),
+    [  8] = H2_DEF_KNOWN("location", "Location", 0),
+    [ 59] = H2_DEF_KNOWN("max-forwards", "Max-Forwards", 0),
+    [ 77] = H2_DEF_KNOWN("origin", "Origin", 0),
+    [ 93] = H2_DEF_KNOWN("permissions-policy", "Permissions-Policy", 0),
+    [161] = H2_DEF_KNOWN("pragma", "Pragma", 0),
+    [148] = H2_DEF_KNOWN("priority", "Priority", 0),
+    [181] = H2_DEF_KNOWN("proxy-authenticate", "Proxy-Authenticate", 0),
+    [218] = H2_DEF_KNOWN("proxy-authorization", "Proxy-Authorization", 0),
+    [230] = H2_DEF_KNOWN("proxy-connection",
+                         "Proxy-Connection", H2_KH_IGNORE|H2_KH_HOP),
+    [ 87] = H2_DEF_KNOWN("purpose", "Purpose", 0),
+    [123] = H2_DEF_KNOWN("push-policy", "Push-Policy", 0),
+    [139] = H2_DEF_KNOWN("range", "Range", 0),
+    [ 60] = H2_DEF_KNOWN("referer", "Referer", 0),
+    [  9] = H2_DEF_KNOWN("referrer-policy", "Referrer-Policy", 0),
+    [197] = H2_DEF_KNOWN("retry-after", "Retry-After", 0),
+    [150] = H2_DEF_KNOWN("save-data", "Save-Data", 0),
+    [225] = H2_DEF_KNOWN("sec-ch-ua", "Sec-Ch-Ua", 0),
+    [166] = H2_DEF_KNOWN("sec-ch-ua-mobile", "Sec-Ch-Ua-Mobile", 0),
+    [241] = H2_DEF_KNOWN("sec-ch-ua-platform", "Sec-Ch-Ua-Platform", 0),
+    [ 56] = H2_DEF_KNOWN("sec-fetch-dest", "Sec-Fetch-Dest", 0),
+    [237] = H2_DEF_KNOWN("sec-fetch-mode", "Sec-Fetch-Mode", 0),
+    [227] = H2_DEF_KNOWN("sec-fetch-site", "Sec-Fetch-Site", 0),
+    [159] = H2_DEF_KNOWN("sec-fetch-user", "Sec-Fetch-User", 0),
+    [189] = H2_DEF_KNOWN("sec-purpose", "Sec-Purpose", 0),
+    [201] = H2_DEF_KNOWN("server", "Server", 0),
+    [163] = H2_DEF_KNOWN("server-timing", "Server-Timing", 0),
+    [ 57] = H2_DEF_KNOWN("set-cookie", "Set-Cookie", 0),
+    [ 94] = H2_DEF_KNOWN("strict-transport-security",
+                         "Strict-Transport-Security", 0),
+    [180] = H2_DEF_KNOWN("te", "Te", 0),
+    [ 95] = H2_DEF_KNOWN("timing-allow-origin", "Timing-Allow-Origin", 0),
+    [ 25] = H2_DEF_KNOWN("trailer", "Trailer", 0),
+    [ 73] = H2_DEF_KNOWN("transfer-encoding",
+                         "Transfer-Encoding", H2_KH_IGNORE|H2_KH_HOP),
+    [242] = H2_DEF_KNOWN("upgrade", "Upgrade", H2_KH_IGNORE|H2_KH_HOP),
+    [187] = H2_DEF_KNOWN("upgrade-insecure-requests",
+                         "Upgrade-Insecure-Requests", 0),
+    [ 97] = H2_DEF_KNOWN("user-agent", "User-Agent", 0),
+    [ 31] = H2_DEF_KNOWN("vary", "Vary", 0),
+    [130] = H2_DEF_KNOWN("via", "Via", 0),
+    [ 79] = H2_DEF_KNOWN("warning", "Warning", 0),
+    [125] = H2_DEF_KNOWN("www-authenticate", "Www-Authenticate", 0),
+    [ 90] = H2_DEF_KNOWN("x-content-type-options",
+                         "X-Content-Type-Options", 0),
+    [106] = H2_DEF_KNOWN("x-forwarded-for", "X-Forwarded-For", 0),
+    [175] = H2_DEF_KNOWN("x-forwarded-host", "X-Forwarded-Host", 0),
+    [216] = H2_DEF_KNOWN("x-forwarded-proto", "X-Forwarded-Proto", 0),
+    [153] = H2_DEF_KNOWN("x-frame-options", "X-Frame-Options", 0),
+    [141] = H2_DEF_KNOWN("x-requested-with", "X-Requested-With", 0),
+    [ 68] = H2_DEF_KNOWN("x-xss-protection", "X-Xss-Protection", 0),
+};
+
+static unsigned int known_hash(const char *name, size_t len)
+{
+    apr_uint32_t x = 0;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        /* lower-cases letters, leaves digits and '-' alone */
+        x = x * 31 + (((unsigned char)name[i]) | 0x20);
+    }
+    return (unsigned int)((apr_uint32_t)(x * 0x1fcdb3du) >> 24);
+}
+
+static const known_header *known_header_get(const char *name, size_t len)
+{
+    const known_header *kh = &KnownHeaders[known_hash(name, len)];
+    
+    if (kh->lname && kh->len == len && !strncasecmp(kh->lname, name, len)) {
+        return kh;
+    }
+    return NULL;
+}
+
+const char *h2_util_known_header(const char *name, size_t len)
+{
+    const known_header *kh = known_header_get(name, len);
+    return kh? kh->name : NULL;
+}
+
 int h2_util_ignore_header(const char *name) 
 {
     /* never forward, ch. 8.1.2.2 */
-    return (H2_HD_MATCH_LIT_CS("connection", name)
-            || H2_HD_MATCH_LIT_CS("proxy-connection", name)
-            || H2_HD_MATCH_LIT_CS("upgrade", name)
-            || H2_HD_MATCH_LIT_CS("keep-alive", name)
-            || H2_HD_MATCH_LIT_CS("transfer-encoding", name));
+    const known_header *kh = known_header_get(name, strlen(name));
+    return kh && (kh->flags & H2_KH_HOP);
 }
 
 static int count_header(void *ctx, const char *key, const char *value)
@@ -1599,6 +1941,13 @@ static int is_unsafe(h2_headers *h)
 apr_status_t h2_res_create_ngtrailer(h2_ngheader **ph, apr_pool_t *p, 
                                     h2_headers *headers)
 {
+    if (headers->ngh) {
+        /* the same fields, without the ":status" in front */
+        *ph = apr_pcalloc(p, sizeof(h2_ngheader));
+        (*ph)->nv = headers->ngh->nv + 1;
+        (*ph)->nvlen = headers->ngh->nvlen - 1;
+        return APR_SUCCESS;
+    }
     return ngheader_create(ph, p, is_unsafe(headers), 
                            0, NULL, NULL, headers->headers);
 }
@@ -1609,13 +1958,283 @@ apr_status_t h2_res_create_ngheader(h2_ngheader **ph, apr_pool_t *p,
     const char *keys[] = {
         ":status"
     };
-    const char *values[] = {
-        apr_psprintf(p, "%d", headers->status)
-    };
+    const char *values[1];
+
+    if (headers->ngh) {
+        *ph = headers->ngh;
+        return APR_SUCCESS;
+    }
+    values[0] = apr_psprintf(p, "%d", headers->status);
     return ngheader_create(ph, p, is_unsafe(headers),  
                            H2_ALEN(keys), keys, values, headers->headers);
 }
 
+/* A h2_ngheader in a single block of memory that also holds the
+ * names and values. Entries have the NO_COPY flags, since nghttp2
+ * may read them in place while the block lives. A block made from
+ * a cached header set may point into that set's block instead. */
+typedef struct ngh_block ngh_block;
+struct ngh_block {
+    h2_ngheader ngh;
+    apr_size_t nvmax;
+    apr_uint32_t refs;
+    ngh_block *base;        /* block we share names and values with */
+};
+
+#define H2_NGH_NO_COPY  (NGHTTP2_NV_FLAG_NO_COPY_NAME|NGHTTP2_NV_FLAG_NO_COPY_VALUE)
+
+#define H2_NGH_CACHE_SLOTS  16
+
+struct h2_ngheader_cache {
+    apr_thread_mutex_t *lock;
+    struct {
+        apr_uint32_t fp;
+        int status;         /* fingerprints may collide, compare these */
+        int unsafe;
+        ngh_block *base;
+    } slots[H2_NGH_CACHE_SLOTS];
+};
+
+static apr_status_t ngh_make(ngh_block **pblock, h2_headers *headers, 
+                             int unsafe, apr_size_t blen, ngh_block *base)
+{
+    const apr_array_header_t *arr = apr_table_elts(headers->headers);
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)arr->elts;
+    const known_header *kh;
+    const nghttp2_nv *bnv = base? base->ngh.nv : NULL;
+    apr_size_t bnvlen = base? base->ngh.nvlen : 0;
+    ngh_block *block;
+    nghttp2_nv *nv;
+    char *buf;
+    apr_size_t nvmax, nlen, vlen, i, j, k;
+
+    /* ":status", the fields and one spare for h2_ngheader_set_static() */
+    nvmax = (apr_size_t)arr->nelts + 2;
+    block = malloc(sizeof(*block) + nvmax * sizeof(nghttp2_nv) + blen);
+    if (!block) {
+        return APR_ENOMEM;
+    }
+    block->ngh.nv = nv = (nghttp2_nv *)(block + 1);
+    block->nvmax = nvmax;
+    block->refs = 1;
+    block->base = base;
+    buf = (char *)(nv + nvmax);
+
+    if (base) {
+        /* the cache hands out a base only for the same status */
+        nv[0] = bnv[0];
+    }
+    else {
+        vlen = (apr_size_t)apr_snprintf(buf, 16, "%d", headers->status);
+        H2_CREATE_NV_LIT_CS(nv, ":status", buf);
+        nv->flags = H2_NGH_NO_COPY;
+        buf += vlen + 1;
+    }
+    for (i = 0, j = 1; i < (apr_size_t)arr->nelts; ++i) {
+        if (!elts[i].key) continue;
+        nlen = strlen(elts[i].key);
+        vlen = strlen(elts[i].val);
+        if (j < bnvlen && bnv[j].namelen == nlen
+            && !strncasecmp((const char *)bnv[j].name, elts[i].key, nlen)) {
+            /* same field as in the cached set, checked there already */
+            nv[j].name = bnv[j].name;
+            if (bnv[j].valuelen == vlen && !memcmp(bnv[j].value, elts[i].val, vlen)) {
+                nv[j] = bnv[j];
+                ++j;
+                continue;
+            }
+        }
+        else if ((kh = known_header_get(elts[i].key, nlen))) {
+            if (kh->flags & H2_KH_HOP) continue;
+            nv[j].name = (uint8_t *)kh->lname;
+        }
+        else {
+            if (!unsafe && inv_field_name_chr(elts[i].key)) goto invalid;
+            nv[j].name = (uint8_t *)buf;
+            for (k = 0; k < nlen; ++k) {
+                buf[k] = apr_tolower(elts[i].key[k]);
+            }
+            buf[nlen] = '\0';
+            buf += nlen + 1;
+        }
+        nv[j].namelen = nlen;
+        if (!unsafe && inv_field_value_chr(elts[i].val)) goto invalid;
+        memcpy(buf, elts[i].val, vlen + 1);
+        nv[j].value = (uint8_t *)buf;
+        nv[j].valuelen = vlen;
+        nv[j].flags = H2_NGH_NO_COPY;
+        buf += vlen + 1;
+        ++j;
+    }
+    block->ngh.nvlen = j;
+    *pblock = block;
+    return APR_SUCCESS;
+
+invalid:
+    free(block);
+    *pblock = NULL;
+    return APR_EINVAL;
+}
+
+apr_status_t h2_res_make_ngheader(h2_ngheader **ph, h2_headers *headers,
+                                  h2_ngheader_cache *cache)
+{
+    const apr_array_header_t *arr = apr_table_elts(headers->headers);
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)arr->elts;
+    ngh_block *block, *base = NULL, *old;
+    apr_uint32_t fp;
+    apr_size_t blen, nlen, i, k;
+    unsigned int slot;
+    int unsafe = is_unsafe(headers);
+    apr_status_t rv;
+
+    /* The fingerprint covers status and names. Responses with the
+     * same fields then differ only in some values, e.g. content-length. */
+    fp = (apr_uint32_t)headers->status * 2 + (unsafe? 1 : 0);
+    blen = 16;
+    for (i = 0; i < (apr_size_t)arr->nelts; ++i) {
+        if (elts[i].key) {
+            nlen = strlen(elts[i].key);
+            for (k = 0; k < nlen; ++k) {
+                fp = fp * 31 + (((unsigned char)elts[i].key[k]) | 0x20);
+            }
+            fp = fp * 31 + ':';
+            blen += nlen + strlen(elts[i].val) + 2;
+        }
+    }
+
+    if (cache) {
+        slot = (apr_uint32_t)(fp * 0x9e3779b1u) >> 28;
+        apr_thread_mutex_lock(cache->lock);
+        if (cache->slots[slot].base && cache->slots[slot].fp == fp
+            && cache->slots[slot].status == headers->status
+            && cache->slots[slot].unsafe == unsafe) {
+            base = cache->slots[slot].base;
+            apr_atomic_inc32(&base->refs);
+        }
+        apr_thread_mutex_unlock(cache->lock);
+
+        if (!base) {
+            /* A header set not seen before. Check it once into a block 
+             * of its own for the cache and point the response into it,
+             * as later ones will. */
+            rv = ngh_make(&base, headers, unsafe, blen, NULL);
+            if (APR_SUCCESS != rv) {
+                *ph = NULL;
+                return rv;
+            }
+            apr_atomic_inc32(&base->refs);
+            apr_thread_mutex_lock(cache->lock);
+            old = cache->slots[slot].base;
+            cache->slots[slot].fp = fp;
+            cache->slots[slot].status = headers->status;
+            cache->slots[slot].unsafe = unsafe;
+            cache->slots[slot].base = base;
+            apr_thread_mutex_unlock(cache->lock);
+            if (old) {
+                h2_ngheader_unref(&old->ngh);
+            }
+        }
+    }
+
+    /* a block made with base keeps our reference to it */
+    rv = ngh_make(&block, headers, unsafe, blen, base);
+    if (APR_SUCCESS != rv) {
+        if (base) {
+            h2_ngheader_unref(&base->ngh);
+        }
+        *ph = NULL;
+        return rv;
+    }
+    *ph = &block->ngh;
+    return APR_SUCCESS;
+}
+
+void h2_ngheader_ref(h2_ngheader *ngh)
+{
+    apr_atomic_inc32(&((ngh_block *)ngh)->refs);
+}
+
+void h2_ngheader_unref(h2_ngheader *ngh)
+{
+    ngh_block *block = (ngh_block *)ngh;
+    if (!apr_atomic_dec32(&block->refs)) {
+        if (block->base) {
+            h2_ngheader_unref(&block->base->ngh);
+        }
+        free(block);
+    }
+}
+
+static apr_status_t ngh_cache_cleanup(void *data)
+{
+    h2_ngheader_cache *cache = data;
+    int i;
+
+    for (i = 0; i < H2_NGH_CACHE_SLOTS; ++i) {
+        if (cache->slots[i].base) {
+            h2_ngheader_unref(&cache->slots[i].base->ngh);
+            cache->slots[i].base = NULL;
+        }
+    }
+    return APR_SUCCESS;
+}
+
+apr_status_t h2_ngheader_cache_create(h2_ngheader_cache **pcache, apr_pool_t *pool)
+{
+    h2_ngheader_cache *cache;
+    apr_status_t rv;
+
+    cache = apr_pcalloc(pool, sizeof(*cache));
+    rv = apr_thread_mutex_create(&cache->lock, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (APR_SUCCESS != rv) {
+        *pcache = NULL;
+        return rv;
+    }
+    apr_pool_cleanup_register(pool, cache, ngh_cache_cleanup, apr_pool_cleanup_null);
+    *pcache = cache;
+    return APR_SUCCESS;
+}
+
+const char *h2_ngheader_get(const h2_ngheader *ngh, const char *lname)
+{
+    apr_size_t i, len = strlen(lname);
+
+    for (i = 0; i < ngh->nvlen; ++i) {
+        if (ngh->nv[i].namelen == len && !memcmp(ngh->nv[i].name, lname, len)) {
+            return (const char *)ngh->nv[i].value;
+        }
+    }
+    return NULL;
+}
+
+apr_status_t h2_ngheader_set_static(h2_ngheader *ngh, const char *lname,
+                                    const char *value)
+{
+    ngh_block *block = (ngh_block *)ngh;
+    nghttp2_nv *nv = NULL;
+    apr_size_t i, len = strlen(lname);
+
+    for (i = 0; i < ngh->nvlen; ++i) {
+        if (ngh->nv[i].namelen == len && !memcmp(ngh->nv[i].name, lname, len)) {
+            nv = &ngh->nv[i];
+            break;
+        }
+    }
+    if (!nv) {
+        if (ngh->nvlen >= block->nvmax) {
+            return APR_ENOSPC;
+        }
+        nv = &ngh->nv[ngh->nvlen++];
+        nv->name = (uint8_t *)lname;
+        nv->namelen = len;
+    }
+    nv->value = (uint8_t *)value;
+    nv->valuelen = strlen(value);
+    nv->flags = H2_NGH_NO_COPY;
+    return APR_SUCCESS;
+}
+
 apr_status_t h2_req_create_ngheader(h2_ngheader **ph, apr_pool_t *p, 
                                     const struct h2_request *req)
 {
@@ -1722,56 +2341,99 @@ int h2_res_ignore_trailer(const char *name, size_t len)
 
 apr_status_t h2_req_add_header(apr_table_t *headers, apr_pool_t *pool, 
                               const char *name, size_t nlen,
-                              const char *value, size_t vlen,
+                              const char *value, size_t vlen, int value_kept,
                               size_t max_field_len, int *pwas_added)
 {
-    char *hname, *hvalue;
-    const char *existing;
+    const known_header *kh;
+    const char *hname, *hvalue, *existing;
     
     *pwas_added = 0;
-    if (h2_req_ignore_header(name, nlen)) {
-        return APR_SUCCESS;
-    }
-    else if (H2_HD_MATCH_LIT("cookie", name, nlen)) {
-        existing = apr_table_get(headers, "cookie");
-        if (existing) {
-            char *nval;
-            
-            /* Cookie header come separately in HTTP/2, but need
-             * to be merged by "; " (instead of default ", ")
-             */
-            if (max_field_len && strlen(existing) + vlen + nlen + 4 > max_field_len) {
-                /* "key: oldval, nval" is too long */
-                return APR_EINVAL;
-            }
-            hvalue = apr_pstrndup(pool, value, vlen);
-            nval = apr_psprintf(pool, "%s; %s", existing, hvalue);
-            apr_table_setn(headers, "Cookie", nval);
+    kh = known_header_get(name, nlen);
+    if (kh) {
+        if (kh->flags & H2_KH_IGNORE) {
             return APR_SUCCESS;
         }
-    }
-    else if (H2_HD_MATCH_LIT("host", name, nlen)) {
-        if (apr_table_get(headers, "Host")) {
+        else if ((kh->flags & H2_KH_HOST) && apr_table_get(headers, "Host")) {
             return APR_SUCCESS; /* ignore duplicate */
         }
+        hname = kh->name;
+    }
+    else {
+        char *s = apr_pstrndup(pool, name, nlen);
+        h2_util_camel_case_header(s, nlen);
+        hname = s;
+    }
+    
+    if (max_field_len && vlen + nlen + 2 > max_field_len) {
+        /* "key: nval" is too long */
+        return APR_EINVAL;
+    }
+    hvalue = value_kept? value : apr_pstrndup(pool, value, vlen);
+    if (kh && (kh->flags & H2_KH_COOKIE)) {
+        /* Cookie header come separately in HTTP/2, but need
+         * to be merged by "; " (instead of default ", "). Collect
+         * them here and join them once in h2_req_join_cookies(). */
+        if (!apr_table_get(headers, "Cookie")) *pwas_added = 1;
+        apr_table_addn(headers, "Cookie", hvalue);
+        return APR_SUCCESS;
     }
     
-    hname = apr_pstrndup(pool, name, nlen);
-    h2_util_camel_case_header(hname, nlen);
     existing = apr_table_get(headers, hname);
-    if (max_field_len) {
-        if ((existing? strlen(existing)+2 : 0) + vlen + nlen + 2 > max_field_len) {
-            /* "key: (oldval, )?nval" is too long */
-            return APR_EINVAL;
-        }
+    if (max_field_len && existing 
+        && strlen(existing) + 2 + vlen + nlen + 2 > max_field_len) {
+        /* "key: oldval, nval" is too long */
+        return APR_EINVAL;
     }
     if (!existing) *pwas_added = 1;
-    hvalue = apr_pstrndup(pool, value, vlen);
     apr_table_mergen(headers, hname, hvalue);
     
     return APR_SUCCESS;
 }
 
+typedef struct {
+    apr_size_t len;
+    int count;
+    char *buf;
+} cookie_ctx;
+
+static int cookie_len(void *baton, const char *key, const char *value)
+{
+    cookie_ctx *ctx = baton;
+    (void)key;
+    ctx->len += (ctx->count++? 2 : 0) + strlen(value);
+    return 1;
+}
+
+static int cookie_copy(void *baton, const char *key, const char *value)
+{
+    cookie_ctx *ctx = baton;
+    apr_size_t vlen = strlen(value);
+    (void)key;
+    if (ctx->count++) {
+        memcpy(ctx->buf + ctx->len, "; ", 2);
+        ctx->len += 2;
+    }
+    memcpy(ctx->buf + ctx->len, value, vlen);
+    ctx->len += vlen;
+    return 1;
+}
+
+void h2_req_join_cookies(apr_table_t *headers, apr_pool_t *pool)
+{
+    cookie_ctx ctx;
+    
+    memset(&ctx, 0, sizeof(ctx));
+    apr_table_do(cookie_len, &ctx, headers, "Cookie", NULL);
+    if (ctx.count > 1) {
+        ctx.buf = apr_palloc(pool, ctx.len + 1);
+        ctx.len = 0;
+        ctx.count = 0;
+        apr_table_do(cookie_copy, &ctx, headers, "Cookie", NULL);
+        ctx.buf[ctx.len] = '\0';
+        apr_table_setn(headers, "Cookie", ctx.buf);
+    }
+}
+
 /*******************************************************************************
  * frame logging
  ******************************************************************************/
@@ -34,6 +34,12 @@ size_t h2_util_header_print(char *buffer, size_t maxlen,
 
 void h2_util_camel_case_header(char *s, size_t len);
 
+/**
+ * Look up a well-known header name, ignoring case.
+ * @return the camel-cased name or NULL if the name is not a known one
+ */
+const char *h2_util_known_header(const char *name, size_t len);
+
 int h2_util_frame_print(const nghttp2_frame *frame, char *buffer, size_t maxlen);
 
 /*******************************************************************************
@@ -319,6 +325,67 @@ apr_status_t h2_ififo_try_peek(h2_ififo *fifo, h2_ififo_peek_fn *fn, void *ctx);
  */
 apr_status_t h2_ififo_remove(h2_ififo *fifo, int id);
 
+/*******************************************************************************
+ * token bucket
+ ******************************************************************************/
+
+/**
+ * A token bucket, filled with `rate` tokens per second up to `burst`
+ * tokens. Levels are kept in millionth of a token. Not thread-safe.
+ */
+typedef struct {
+    apr_int64_t level;          /* tokens available * APR_USEC_PER_SEC */
+    apr_time_t last;            /* when level was last updated */
+} h2_tbucket;
+
+/**
+ * Initialize the bucket with `burst` tokens available.
+ */
+void h2_tbucket_init(h2_tbucket *tb, int burst, apr_time_t now);
+
+/**
+ * Refill the bucket for the time passed and take one token.
+ * @param tb the bucket
+ * @param rate the tokens added per second
+ * @param burst the max number of tokens the bucket holds
+ * @param now the current time
+ * @return != 0 iff a token was available
+ */
+int h2_tbucket_take(h2_tbucket *tb, int rate, int burst, apr_time_t now);
+
+/*******************************************************************************
+ * nghttp2 memory
+ ******************************************************************************/
+#ifdef H2_NG2_MEM
+
+/**
+ * A nghttp2_mem that allocates from a pool. Freed memory goes on
+ * freelists by power of 2 size classes and is reused for the next
+ * allocation of that class. Large ones come from malloc().
+ * The pool frees all of it in one step, so it must live longer than
+ * the nghttp2 session. Not thread-safe, like the nghttp2 session.
+ */
+typedef struct h2_ngmem h2_ngmem;
+
+struct h2_ngmem {
+    nghttp2_mem mem;            /* give this to nghttp2 */
+    apr_pool_t *pool;
+    void *freelist[12];         /* 32 bytes to 64 KB */
+
+    apr_size_t allocs;          /* # of allocations */
+    apr_size_t reused;          /* # of allocations taken from a freelist */
+    apr_size_t large;           /* # of allocations too large for the pool */
+    apr_size_t in_use;          /* bytes currently allocated */
+    apr_size_t peak;            /* max of in_use seen */
+    apr_size_t arena;           /* bytes taken from the pool */
+};
+
+/**
+ * Create a nghttp2 allocator for the pool.
+ */
+h2_ngmem *h2_ngmem_create(apr_pool_t *pool);
+#endif /* H2_NG2_MEM */
+
 /*******************************************************************************
  * common helpers
  ******************************************************************************/
@@ -409,15 +476,69 @@ apr_status_t h2_res_create_ngheader(h2_ngheader **ph, apr_pool_t *p,
 apr_status_t h2_req_create_ngheader(h2_ngheader **ph, apr_pool_t *p, 
                                     const struct h2_request *req);
 
+/**
+ * A cache of response header sets already made into HTTP/2 form, for
+ * the responses of one session. Safe to use from several threads.
+ */
+typedef struct h2_ngheader_cache h2_ngheader_cache;
+
+/**
+ * Create a header set cache, emptied when the pool is destroyed.
+ */
+apr_status_t h2_ngheader_cache_create(h2_ngheader_cache **pcache, apr_pool_t *pool);
+
+/**
+ * Make the HTTP/2 form of a response's header fields: ":status" first,
+ * then the table's fields with lower-cased names, as nghttp2 takes them.
+ * Fields and strings are copied once into a single block of memory that
+ * belongs to no pool. Entries are flagged so that nghttp2 does not copy
+ * them again. The block starts with one reference.
+ * When the cache has a set with the same status and field names, fields
+ * with the same value are taken from there without checking or copying.
+ * @param cache the cache to use or NULL
+ * @return APR_EINVAL if a field has invalid characters
+ */
+apr_status_t h2_res_make_ngheader(h2_ngheader **ph, struct h2_headers *headers,
+                                  h2_ngheader_cache *cache);
+
+void h2_ngheader_ref(h2_ngheader *ngh);
+
+/**
+ * Drop a reference to a h2_ngheader made by h2_res_make_ngheader(),
+ * freeing it with the last one.
+ */
+void h2_ngheader_unref(h2_ngheader *ngh);
+
+/**
+ * Get the value of the field with the given lower-case name.
+ */
+const char *h2_ngheader_get(const h2_ngheader *ngh, const char *lname);
+
+/**
+ * Set a field to strings that live forever, replacing an existing value.
+ * A h2_ngheader made by h2_res_make_ngheader() has room for one field
+ * more than it was made with.
+ */
+apr_status_t h2_ngheader_set_static(h2_ngheader *ngh, const char *lname,
+                                    const char *value);
+
 /**
  * Add a HTTP/2 header and return the table key if it really was added
  * and not ignored.
+ * @param value_kept != 0 if value is NUL-terminated and lives as long
+ *                   as pool, it is then added without copying
  */
 apr_status_t h2_req_add_header(apr_table_t *headers, apr_pool_t *pool, 
                                const char *name, size_t nlen,
-                               const char *value, size_t vlen,
+                               const char *value, size_t vlen, int value_kept,
                                size_t max_field_len, int *pwas_added);
 
+/**
+ * Join the "Cookie" values that h2_req_add_header() collected into
+ * a single header, separated by "; ".
+ */
+void h2_req_join_cookies(apr_table_t *headers, apr_pool_t *pool);
+
 /*******************************************************************************
  * apr brigade helpers
  ******************************************************************************/
@@ -520,6 +641,12 @@ apr_status_t h2_append_brigade(apr_bucket_brigade *to,
  */
 apr_off_t h2_brigade_mem_size(apr_bucket_brigade *bb);
 
+/**
+ * Get an approximation of the memory footprint of a single bucket,
+ * counted the same way as in h2_brigade_mem_size().
+ */
+apr_off_t h2_bucket_mem_size(apr_bucket *b);
+
 /**
  * Drain a pipe used for notification.
  */
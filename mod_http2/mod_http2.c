@@ -39,6 +39,7 @@
 #include "h2_mplx.h"
 #include "h2_push.h"
 #include "h2_request.h"
+#include "h2_status.h"
 #include "h2_switch.h"
 #include "h2_version.h"
 #include "h2_bucket_beam.h"
@@ -235,6 +236,7 @@ static void h2_hooks(apr_pool_t *pool)
     h2_c1_register_hooks();
     h2_switch_register_hooks();
     h2_c2_register_hooks();
+    h2_status_register_hooks();
 
     /* Setup subprocess env for certain variables
      */
@@ -322,6 +324,19 @@ static const char *val_H2_STREAM_ID(apr_pool_t *p, server_rec *s,
     return NULL;
 }
 
+static const char *val_H2_TLS_RECORD_SIZE(apr_pool_t *p, server_rec *s,
+                                          conn_rec *c, request_rec *r,
+                                          h2_conn_ctx_t *ctx)
+{
+    if (c) {
+        h2_conn_ctx_t *conn_ctx = h2_conn_ctx_get(c->master? c->master : c);
+        if (conn_ctx && conn_ctx->session && conn_ctx->session->io.is_tls) {
+            return apr_ltoa(p, (long)conn_ctx->session->io.write_size);
+        }
+    }
+    return "";
+}
+
 typedef const char *h2_var_lookup(apr_pool_t *p, server_rec *s,
                                   conn_rec *c, request_rec *r, h2_conn_ctx_t *ctx);
 typedef struct h2_var_def {
@@ -338,6 +353,7 @@ static h2_var_def H2_VARS[] = {
     { "H2_PUSHED_ON",        val_H2_PUSHED_ON, 1 },
     { "H2_STREAM_ID",        val_H2_STREAM_ID, 1 },
     { "H2_STREAM_TAG",       val_H2_STREAM_TAG, 1 },
+    { "H2_TLS_RECORD_SIZE",  val_H2_TLS_RECORD_SIZE, 1 },
 };
 
 #ifndef H2_ALEN
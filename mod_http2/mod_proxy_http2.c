@@ -14,9 +14,14 @@
  * limitations under the License.
  */
  
+#include <stdlib.h>
 #include <nghttp2/nghttp2.h>
 
+#include <apr_thread_cond.h>
+#include <apr_thread_mutex.h>
+
 #include <ap_mmn.h>
+#include <ap_mpm.h>
 #include <httpd.h>
 #include <mod_proxy.h>
 #include "mod_http2.h"
@@ -48,6 +53,25 @@ AP_DECLARE_MODULE(proxy_http2) = {
 /* Optional functions from mod_http2 */
 static int (*is_h2)(conn_rec *c);
 
+typedef enum {
+    H2_PROXY_CTX_OWN,           /* runs the request in its own session */
+    H2_PROXY_CTX_QUEUED,        /* waits to be taken by a running session */
+    H2_PROXY_CTX_ADOPTED,       /* is a stream in another request's session */
+    H2_PROXY_CTX_DONE,          /* was processed by another request's session */
+    H2_PROXY_CTX_RETURNED,      /* was not processed, needs to run on its own */
+} h2_proxy_ctx_state;
+
+struct h2_proxy_engine;
+
+/* response DATA taken from the driver's session, for the adopted
+ * request's own thread to pass on */
+typedef struct h2_proxy_chunk h2_proxy_chunk;
+struct h2_proxy_chunk {
+    h2_proxy_chunk *next;
+    apr_size_t len;
+    char data[1];
+};
+
 typedef struct h2_proxy_ctx {
     const char *id;
     conn_rec *master;
@@ -64,6 +88,21 @@ typedef struct h2_proxy_ctx {
     int capacity;
     
     unsigned is_ssl : 1;
+    unsigned h2_front : 1;
+    
+    const char *site;          /* backend the session may be shared for, or NULL */
+    const char *site_host;     /* preserved Host: for the backend, or NULL */
+    struct h2_proxy_engine *engine; /* engine the ctx drives or is queued at */
+    h2_proxy_ctx_state e_state;
+    struct h2_proxy_ctx *e_next; /* next ctx in the engine queue */
+    struct h2_proxy_ctx *e_anext; /* next ctx adopted by the engine */
+    apr_thread_cond_t *e_cond; /* signals changes of e_state and e_out */
+    h2_proxy_chunk *e_out;     /* response DATA to pass on */
+    h2_proxy_chunk *e_out_tail;
+    int e_out_eos;             /* response without body, pass EOS */
+    int e_stream_id;           /* stream of the request in the driver's session */
+    apr_size_t e_passed;       /* passed on, not yet reported to the session */
+    int e_cancel;              /* 1: driver is to reset the stream, 2: it did */
     
     request_rec *r;            /* the request processed in this ctx */
     apr_status_t r_status;     /* status of request work */
@@ -72,6 +111,47 @@ typedef struct h2_proxy_ctx {
     h2_proxy_session *session; /* current http2 session against backend */
 } h2_proxy_ctx;
 
+/* A request that runs a session against a backend drives an engine.
+ * Requests for the same backend that come in meanwhile, on any
+ * connection, queue there and get added as streams to the session.
+ * The driving thread processes all streams. The threads of the others
+ * wait until their request is done and pass its response DATA on to
+ * their client, so a slow client never blocks the driver. When the
+ * driver's own request is done, it stops taking new ones and returns
+ * once its adopted ones are finished. */
+typedef struct h2_proxy_engine h2_proxy_engine;
+struct h2_proxy_engine {
+    h2_proxy_engine *next;
+    proxy_worker *worker;
+    server_rec *server;
+    const char *site;          /* scheme://hostinfo of the backend */
+    const char *host;          /* Host: and SNI with ProxyPreserveHost, or NULL */
+    apr_pool_t *pool;          /* of site and host, cleared on reuse */
+    int h2_front;
+    h2_proxy_ctx *driver;      /* ctx running the session, NULL if none */
+    h2_proxy_ctx *queue;       /* ctxs waiting to be added */
+    h2_proxy_ctx *queue_tail;
+    h2_proxy_ctx *adopted_ctxs; /* ctxs with a stream in the session */
+    int nstreams;              /* streams in the session and queued */
+    int adopted;               /* streams of other ctxs in the session */
+    int max_streams;           /* the backend's max concurrent streams */
+    int closing;               /* driver takes no more streams */
+};
+
+/* How long a shared session blocks on the backend before
+ * it looks for queued requests again. */
+#define H2_PROXY_ENGINE_WAIT    apr_time_from_msec(20)
+/* How often a waiting request looks if its client or the
+ * engine has given up. */
+#define H2_PROXY_ENGINE_POLL    apr_time_from_msec(100)
+/* Engines per child. One no request drives is reused for
+ * another backend, past this no new ones are made. */
+#define H2_PROXY_ENGINES_MAX    64
+
+static apr_pool_t *engines_pool;
+static apr_thread_mutex_t *engines_lock;
+static h2_proxy_engine *engines;
+
 static int h2_proxy_post_config(apr_pool_t *p, apr_pool_t *plog,
                                 apr_pool_t *ptemp, server_rec *s)
 {
@@ -98,6 +178,22 @@ static int h2_proxy_post_config(apr_pool_t *p, apr_pool_t *plog,
     return status;
 }
 
+static void h2_proxy_child_init(apr_pool_t *pool, server_rec *s)
+{
+    int threaded = 0;
+    (void)s;
+    
+#if APR_HAS_THREADS
+    ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded);
+    if (threaded && apr_thread_mutex_create(&engines_lock, APR_THREAD_MUTEX_DEFAULT,
+                                            pool) == APR_SUCCESS) {
+        engines_pool = pool;
+    }
+#else
+    (void)pool;(void)threaded;
+#endif
+}
+
 /**
  * canonicalize the url into the request, if it is meant for us.
  * slightly modified copy from mod_http
@@ -204,17 +300,319 @@ static apr_status_t add_request(h2_proxy_session *session, request_rec *r)
     return status;
 }
 
+static int engine_is_for(h2_proxy_engine *e, h2_proxy_ctx *ctx)
+{
+    /* The TLS SNI of the backend connection is the preserved Host,
+     * or else the host of the site. */
+    return (e->worker == ctx->worker && e->server == ctx->server
+            && e->h2_front == ctx->h2_front && !strcmp(e->site, ctx->site)
+            && (e->host? (ctx->site_host && !strcmp(e->host, ctx->site_host))
+                       : !ctx->site_host));
+}
+
+/* engines_lock must be held */
+static h2_proxy_engine *engine_get(h2_proxy_ctx *ctx, int create)
+{
+    h2_proxy_engine *e, *idle = NULL;
+    apr_pool_t *pool;
+    int n = 0;
+    
+    for (e = engines; e; e = e->next, ++n) {
+        if (engine_is_for(e, ctx)) {
+            return e;
+        }
+        if (!e->driver) {
+            idle = e;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    if (idle) {
+        /* Sites may come from the client, do not keep one for
+         * every backend ever seen. */
+        e = idle;
+        apr_pool_clear(e->pool);
+    }
+    else if (n < H2_PROXY_ENGINES_MAX
+             && apr_pool_create(&pool, engines_pool) == APR_SUCCESS) {
+        apr_pool_tag(pool, "h2_proxy_engine");
+        e = apr_pcalloc(engines_pool, sizeof(*e));
+        e->pool = pool;
+        e->next = engines;
+        engines = e;
+    }
+    else {
+        return NULL;
+    }
+    e->worker = ctx->worker;
+    e->server = ctx->server;
+    e->site = apr_pstrdup(e->pool, ctx->site);
+    e->host = ctx->site_host? apr_pstrdup(e->pool, ctx->site_host) : NULL;
+    e->h2_front = ctx->h2_front;
+    return e;
+}
+
+/* engines_lock must be held */
+static void engine_unqueue(h2_proxy_engine *e, h2_proxy_ctx *ctx)
+{
+    h2_proxy_ctx **pctx, *prev = NULL;
+    
+    for (pctx = &e->queue; *pctx; prev = *pctx, pctx = &(*pctx)->e_next) {
+        if (*pctx == ctx) {
+            *pctx = ctx->e_next;
+            if (e->queue_tail == ctx) {
+                e->queue_tail = prev;
+            }
+            --e->nstreams;
+            return;
+        }
+    }
+}
+
+/* Pass the response DATA the driver took for the ctx on to its client.
+ * Runs in the ctx's own thread with engines_lock held, which is
+ * released while passing. */
+static void engine_pass_out(h2_proxy_ctx *ctx, apr_bucket_brigade **pbb)
+{
+    conn_rec *c = ctx->r->connection;
+    h2_proxy_chunk *chunk = ctx->e_out, *next;
+    int eos = ctx->e_out_eos, cancelled = ctx->e_cancel;
+    apr_size_t passed = 0;
+    apr_status_t status = APR_SUCCESS;
+    
+    ctx->e_out = ctx->e_out_tail = NULL;
+    ctx->e_out_eos = 0;
+    apr_thread_mutex_unlock(engines_lock);
+    
+    if (!*pbb) {
+        *pbb = apr_brigade_create(ctx->pool, c->bucket_alloc);
+    }
+    for (; chunk; chunk = next) {
+        next = chunk->next;
+        APR_BRIGADE_INSERT_TAIL(*pbb, apr_bucket_heap_create(chunk->data, chunk->len,
+                                                             NULL, c->bucket_alloc));
+        passed += chunk->len;
+        free(chunk);
+    }
+    APR_BRIGADE_INSERT_TAIL(*pbb, apr_bucket_flush_create(c->bucket_alloc));
+    if (eos) {
+        APR_BRIGADE_INSERT_TAIL(*pbb, apr_bucket_eos_create(c->bucket_alloc));
+    }
+    if (!cancelled) {
+        status = ap_pass_brigade(ctx->r->output_filters, *pbb);
+    }
+    apr_brigade_cleanup(*pbb);
+    
+    apr_thread_mutex_lock(engines_lock);
+    ctx->e_passed += passed;
+    if (status != APR_SUCCESS && !ctx->e_cancel) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, ctx->owner, APLOGNO(10318)
+                      "eng(%s): passing response DATA failed", ctx->id);
+        ctx->e_cancel = 1;
+    }
+}
+
+/* Queue the request at an engine running a session to its backend.
+ * Returns != 0 when that session processed the request. */
+static int engine_hand_over(h2_proxy_ctx *ctx)
+{
+    h2_proxy_engine *e;
+    apr_bucket_brigade *bb = NULL;
+    int processed = 0;
+    
+    apr_thread_mutex_lock(engines_lock);
+    e = engine_get(ctx, 0);
+    if (e && e->driver && !e->closing && e->nstreams < e->max_streams
+        && (ctx->e_cond || apr_thread_cond_create(&ctx->e_cond, ctx->pool)
+                           == APR_SUCCESS)) {
+        ctx->engine = e;
+        ctx->e_state = H2_PROXY_CTX_QUEUED;
+        ctx->e_next = NULL;
+        if (e->queue_tail) {
+            e->queue_tail->e_next = ctx;
+        }
+        else {
+            e->queue = ctx;
+        }
+        e->queue_tail = ctx;
+        ++e->nstreams;
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, ctx->owner, 
+                      "eng(%s): queued at session of %s",
+                      ctx->id, e->driver->id);
+        while (ctx->e_state == H2_PROXY_CTX_QUEUED 
+               || ctx->e_state == H2_PROXY_CTX_ADOPTED
+               || ctx->e_out || ctx->e_out_eos) {
+            if (ctx->e_out || ctx->e_out_eos) {
+                engine_pass_out(ctx, &bb);
+                continue;
+            }
+            apr_thread_cond_timedwait(ctx->e_cond, engines_lock, 
+                                      H2_PROXY_ENGINE_POLL);
+            if (ctx->e_state == H2_PROXY_CTX_QUEUED
+                && (ctx->master->aborted || e->closing)) {
+                /* the driver would only return it later */
+                engine_unqueue(e, ctx);
+                ctx->e_state = H2_PROXY_CTX_RETURNED;
+            }
+            else if (ctx->e_state == H2_PROXY_CTX_ADOPTED
+                     && ctx->master->aborted && !ctx->e_cancel) {
+                ctx->e_cancel = 1;
+            }
+        }
+        processed = (ctx->e_state == H2_PROXY_CTX_DONE);
+        ctx->e_state = H2_PROXY_CTX_OWN;
+        ctx->engine = NULL;
+    }
+    apr_thread_mutex_unlock(engines_lock);
+    return processed;
+}
+
+/* Report a queued or adopted ctx back to its waiting thread. */
+static void engine_release(h2_proxy_ctx *octx, h2_proxy_ctx_state state)
+{
+    h2_proxy_engine *e = octx->engine;
+    
+    apr_thread_mutex_lock(engines_lock);
+    if (octx->e_state == H2_PROXY_CTX_ADOPTED) {
+        h2_proxy_ctx **pctx;
+        
+        for (pctx = &e->adopted_ctxs; *pctx; pctx = &(*pctx)->e_anext) {
+            if (*pctx == octx) {
+                *pctx = octx->e_anext;
+                break;
+            }
+        }
+        --e->adopted;
+    }
+    --e->nstreams;
+    octx->e_state = state;
+    apr_thread_cond_signal(octx->e_cond);
+    apr_thread_mutex_unlock(engines_lock);
+}
+
+static void engine_start(h2_proxy_ctx *ctx)
+{
+    h2_proxy_engine *e;
+    
+    if (!ctx->site) {
+        return;
+    }
+    apr_thread_mutex_lock(engines_lock);
+    e = engine_get(ctx, 1);
+    if (e && !e->driver) {
+        e->driver = ctx;
+        e->nstreams = 1;
+        e->adopted = 0;
+        e->adopted_ctxs = NULL;
+        e->closing = 0;
+        e->max_streams = 100;
+        ctx->engine = e;
+        ctx->session->max_wait = H2_PROXY_ENGINE_WAIT;
+    }
+    apr_thread_mutex_unlock(engines_lock);
+}
+
+static void engine_stop(h2_proxy_ctx *ctx)
+{
+    h2_proxy_engine *e = ctx->engine;
+    h2_proxy_ctx *octx;
+    
+    if (!e) {
+        return;
+    }
+    apr_thread_mutex_lock(engines_lock);
+    for (octx = e->queue; octx; octx = octx->e_next) {
+        octx->e_state = H2_PROXY_CTX_RETURNED;
+        apr_thread_cond_signal(octx->e_cond);
+    }
+    e->queue = e->queue_tail = NULL;
+    e->driver = NULL;
+    e->nstreams = 0;
+    apr_thread_mutex_unlock(engines_lock);
+    ctx->session->max_wait = 0;
+    ctx->engine = NULL;
+}
+
+/* Add the requests queued at the engine to the session. Returns
+ * != 0 while streams of other requests are still in the session. */
+static int engine_pull(h2_proxy_ctx *ctx)
+{
+    h2_proxy_engine *e = ctx->engine;
+    h2_proxy_ctx *octx, *next, *taken = NULL;
+    int adopted;
+    
+    if (!e) {
+        return 0;
+    }
+    apr_thread_mutex_lock(engines_lock);
+    if (ctx->r_done || ctx->master->aborted
+        || !h2_proxy_session_is_accepting(ctx->session)) {
+        e->closing = 1;
+    }
+    else {
+        if (ctx->session->remote_max_concurrent > 0) {
+            e->max_streams = (int)ctx->session->remote_max_concurrent;
+        }
+        taken = e->queue;
+        e->queue = e->queue_tail = NULL;
+        for (octx = taken; octx; octx = octx->e_next) {
+            octx->e_state = H2_PROXY_CTX_ADOPTED;
+            octx->e_anext = e->adopted_ctxs;
+            e->adopted_ctxs = octx;
+            ++e->adopted;
+        }
+    }
+    apr_thread_mutex_unlock(engines_lock);
+    
+    for (octx = taken; octx; octx = next) {
+        next = octx->e_next;
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, ctx->owner, 
+                      "eng(%s): adding request of %s to session %s",
+                      ctx->id, octx->id, ctx->session->id);
+        if (add_request(ctx->session, octx->r) != APR_SUCCESS) {
+            engine_release(octx, H2_PROXY_CTX_RETURNED);
+        }
+    }
+    
+    apr_thread_mutex_lock(engines_lock);
+    for (octx = e->adopted_ctxs; octx; octx = octx->e_anext) {
+        if (octx->e_passed) {
+            h2_proxy_session_consumed(ctx->session, octx->e_stream_id, 
+                                      octx->e_passed);
+            octx->e_passed = 0;
+        }
+        if (octx->e_cancel == 1) {
+            h2_proxy_session_cancel(ctx->session, octx->r);
+            octx->e_cancel = 2;
+        }
+    }
+    adopted = e->adopted;
+    apr_thread_mutex_unlock(engines_lock);
+    return adopted > 0;
+}
+
 static void request_done(h2_proxy_ctx *ctx, request_rec *r,
                          apr_status_t status, int touched)
 {   
-    if (r == ctx->r) {
-        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, status, r->connection, 
-                      "h2_proxy_session(%s): request done, touched=%d",
-                      ctx->id, touched);
-        ctx->r_done = 1;
-        if (touched) ctx->r_may_retry = 0;
-        ctx->r_status = ((status == APR_SUCCESS)? APR_SUCCESS
-                         : HTTP_SERVICE_UNAVAILABLE);
+    h2_proxy_ctx *rctx = ctx;
+    
+    if (r != ctx->r) {
+        /* a request added from the engine queue */
+        rctx = ap_get_module_config(r->connection->conn_config, &proxy_http2_module);
+        if (!rctx || rctx->r != r || rctx->e_state != H2_PROXY_CTX_ADOPTED) {
+            return;
+        }
+    }
+    ap_log_cerror(APLOG_MARK, APLOG_TRACE1, status, r->connection, 
+                  "h2_proxy_session(%s): request done, touched=%d",
+                  rctx->id, touched);
+    rctx->r_done = 1;
+    if (touched) rctx->r_may_retry = 0;
+    rctx->r_status = ((status == APR_SUCCESS)? APR_SUCCESS
+                      : HTTP_SERVICE_UNAVAILABLE);
+    if (rctx != ctx) {
+        engine_release(rctx, H2_PROXY_CTX_DONE);
     }
 }    
 
@@ -224,16 +622,66 @@ static void session_req_done(h2_proxy_session *session, request_rec *r,
     request_done(session->user_data, r, status, touched);
 }
 
+/* Take the response DATA of an adopted request, its own thread passes
+ * it on. The driver never writes to the clients of others. */
+static int session_res_data(h2_proxy_session *session, request_rec *r,
+                            int stream_id, const char *data, apr_size_t len,
+                            int eos)
+{
+    h2_proxy_ctx *ctx = session->user_data, *rctx;
+    h2_proxy_chunk *chunk = NULL;
+    
+    if (!ctx || r == ctx->r) {
+        return 0;
+    }
+    rctx = ap_get_module_config(r->connection->conn_config, &proxy_http2_module);
+    if (!rctx || rctx->r != r) {
+        return 0;
+    }
+    if (len) {
+        chunk = malloc(sizeof(*chunk) + len);
+        if (chunk) {
+            chunk->next = NULL;
+            chunk->len = len;
+            memcpy(chunk->data, data, len);
+        }
+    }
+    apr_thread_mutex_lock(engines_lock);
+    if (rctx->e_state != H2_PROXY_CTX_ADOPTED) {
+        apr_thread_mutex_unlock(engines_lock);
+        free(chunk);
+        return 0;
+    }
+    rctx->e_stream_id = stream_id;
+    if (chunk) {
+        if (rctx->e_out_tail) {
+            rctx->e_out_tail->next = chunk;
+        }
+        else {
+            rctx->e_out = chunk;
+        }
+        rctx->e_out_tail = chunk;
+    }
+    else if (len && !rctx->e_cancel) {
+        /* out of memory, the response is incomplete */
+        rctx->e_cancel = 1;
+    }
+    if (eos) {
+        rctx->e_out_eos = 1;
+    }
+    apr_thread_cond_signal(rctx->e_cond);
+    apr_thread_mutex_unlock(engines_lock);
+    return 1;
+}
+
 static apr_status_t ctx_run(h2_proxy_ctx *ctx) {
     apr_status_t status = OK;
-    int h2_front;
     
     /* Step Four: Send the Request in a new HTTP/2 stream and
      * loop until we got the response or encounter errors.
      */
-    h2_front = is_h2? is_h2(ctx->owner) : 0;
     ctx->session = h2_proxy_session_setup(ctx->id, ctx->p_conn, ctx->conf,
-                                          h2_front, 30, 
+                                          ctx->h2_front, 30, 
                                           h2_proxy_log2((int)ctx->req_buffer_size), 
                                           session_req_done);
     if (!ctx->session) {
@@ -245,11 +693,13 @@ static apr_status_t ctx_run(h2_proxy_ctx *ctx) {
     ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, ctx->owner, APLOGNO(03373)
                   "eng(%s): run session %s", ctx->id, ctx->session->id);
     ctx->session->user_data = ctx;
+    ctx->session->res_data = session_res_data;
     
     ctx->r_done = 0;
     add_request(ctx->session, ctx->r);
+    engine_start(ctx);
     
-    while (!ctx->master->aborted && !ctx->r_done) {
+    while (!ctx->master->aborted && (engine_pull(ctx) || !ctx->r_done)) {
     
         status = h2_proxy_session_process(ctx->session);
         if (status != APR_SUCCESS) {
@@ -271,15 +721,30 @@ out:
         /* master connection gone */
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, status, ctx->owner, 
                       APLOGNO(03374) "eng(%s): master connection gone", ctx->id);
-        /* cancel all ongoing requests */
-        h2_proxy_session_cancel_all(ctx->session);
-        h2_proxy_session_process(ctx->session);
+        if (ctx->engine) {
+            /* only our own request is gone, the requests of others
+             * in the session are driven on until they are done */
+            h2_proxy_session_cancel(ctx->session, ctx->r);
+            while (status == APR_SUCCESS && engine_pull(ctx)) {
+                status = h2_proxy_session_process(ctx->session);
+            }
+            if (status != APR_SUCCESS) {
+                h2_proxy_session_cleanup(ctx->session, session_req_done);
+            }
+        }
+        else {
+            /* cancel all ongoing requests */
+            h2_proxy_session_cancel_all(ctx->session);
+            h2_proxy_session_process(ctx->session);
+        }
         if (!ctx->master->aborted) {
             status = ctx->r_status = APR_SUCCESS;
         }
     }
     
+    engine_stop(ctx);
     ctx->session->user_data = NULL;
+    ctx->session->res_data = NULL;
     ctx->session = NULL;
     return status;
 }
@@ -339,6 +804,7 @@ static int proxy_http2_handler(request_rec *r,
     ctx->r_status = status = HTTP_SERVICE_UNAVAILABLE;
     ctx->r_done = 0;
     ctx->r_may_retry =  1;
+    ctx->h2_front = is_h2? is_h2(ctx->owner) : 0;
     
     ap_set_module_config(ctx->owner->conn_config, &proxy_http2_module, ctx);
 
@@ -347,6 +813,28 @@ static int proxy_http2_handler(request_rec *r,
     ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, ctx->r, 
                   "H2: serving URL %s", url);
     
+    if (engines_lock && r->proxyreq == PROXYREQ_REVERSE && !proxyname
+        && !worker->s->disablereuse
+        && apr_uri_parse(r->pool, url, &uri) == APR_SUCCESS && uri.hostinfo) {
+        proxy_dir_conf *dconf = ap_get_module_config(r->per_dir_config,
+                                                     &proxy_module);
+        /* the backend connection may be shared with other requests */
+        ctx->site = apr_psprintf(r->pool, "%s://%s", uri.scheme, uri.hostinfo);
+        if (dconf->preserve_host) {
+            /* the client's Host: goes to the backend and is the SNI
+             * of the connection, it must be the same to share it */
+            ctx->site_host = r->hostname;
+            if (!ctx->site_host) {
+                ctx->site = NULL;
+            }
+        }
+        /* Only the driver reads a request body, adopted ones have none. */
+        if (ctx->site && !ap_request_has_body(r) && engine_hand_over(ctx)
+            && (ctx->r_status == APR_SUCCESS || !ctx->r_may_retry)) {
+            goto cleanup;
+        }
+    }
+    
 run_connect:    
     if (ctx->master->aborted) goto cleanup;
 
@@ -444,6 +932,7 @@ cleanup:
 static void register_hook(apr_pool_t *p)
 {
     ap_hook_post_config(h2_proxy_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(h2_proxy_child_init, NULL, NULL, APR_HOOK_MIDDLE);
 
     proxy_hook_scheme_handler(proxy_http2_handler, NULL, NULL, APR_HOOK_FIRST);
     proxy_hook_canon_handler(proxy_http2_canon, NULL, NULL, APR_HOOK_FIRST);
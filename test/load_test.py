@@ -66,6 +66,7 @@ class H2LoadLogSummary:
         self._transfered_mb = 0.0
         self._exec_result = None
         self._expected_responses = 0
+        self._syscalls = 0
 
     @property
     def title(self) -> str:
@@ -112,6 +113,13 @@ class H2LoadLogSummary:
     def set_transfered_mb(self, mb: float) -> None:
         self._transfered_mb = mb
 
+    @property
+    def syscalls(self) -> int:
+        return self._syscalls
+
+    def set_syscalls(self, n: int) -> None:
+        self._syscalls = n
+
     def set_exec_result(self, result: ExecResult):
         self._exec_result = result
 
@@ -188,6 +196,56 @@ class H2LoadMonitor:
         self._tqdm.close()
 
 
+def httpd_syscalls(env: H2TestEnv) -> int:
+    """Sum of read+write syscalls done by the running httpd processes,
+       as reported by /proc/<pid>/io on Linux."""
+    pid_file = os.path.join(env.server_dir, 'httpd.pid')
+    if not os.path.isfile(pid_file) or not os.path.isdir('/proc'):
+        return 0
+    with open(pid_file) as fd:
+        ppid = fd.read().strip()
+    count = 0
+    for pid in [d for d in os.listdir('/proc') if d.isdigit()]:
+        try:
+            with open(f"/proc/{pid}/stat") as fd:
+                stat = fd.read()
+            if pid != ppid and stat[stat.rindex(')') + 2:].split()[1] != ppid:
+                continue
+            with open(f"/proc/{pid}/io") as fd:
+                for line in fd:
+                    name, value = line.split(':', 1)
+                    if name in ['syscr', 'syscw']:
+                        count += int(value)
+        except (OSError, ValueError):
+            pass
+    return count
+
+
+# what a current browser sends along with a page request
+BROWSER_HEADERS = [
+    'sec-ch-ua: "Chromium";v="118", "Google Chrome";v="118", "Not=A?Brand";v="99"',
+    'sec-ch-ua-mobile: ?0',
+    'sec-ch-ua-platform: "Linux"',
+    'upgrade-insecure-requests: 1',
+    'user-agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 '
+    '(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36',
+    'accept: text/html,application/xhtml+xml,application/xml;q=0.9,'
+    'image/avif,image/webp,image/apng,*/*;q=0.8',
+    'sec-fetch-site: none',
+    'sec-fetch-mode: navigate',
+    'sec-fetch-user: ?1',
+    'sec-fetch-dest: document',
+    'accept-encoding: gzip, deflate, br',
+    'accept-language: en-US,en;q=0.9,de;q=0.8',
+    'referer: https://www.example.org/start',
+    'if-none-match: "1234-5678abcd"',
+    'if-modified-since: Tue, 17 Oct 2023 10:00:00 GMT',
+    'priority: u=0, i',
+    'x-requested-with: XMLHttpRequest',
+    'x-client-data: CIe2yQEIpLbJAQipncoBCLKKywEIlqHLAQiFoM0B',
+]
+
+
 def mk_text_file(fpath: str, lines: int):
     t110 = ""
     for _ in range(11):
@@ -270,6 +328,7 @@ class LoadTestCase:
             Protocols h2 http/1.1
             ProxyPass /proxy-h1/ https://127.0.0.1:{env.https_port}/
             ProxyPass /proxy-h2/ h2://127.0.0.1:{env.https_port}/
+            ScriptAlias /cgi-load/ "{env.server_docs_dir}/cgi/load/"
             """
         conf = LoadTestCase.setup_base_conf(env=env, extras=extras)
         conf.add_vhost_test1()
@@ -287,7 +346,8 @@ class UrlsLoadTest(LoadTestCase):
                  measure: str,
                  protocol: str = 'h2',
                  max_parallel: int = 1,
-                 threads: int = None, warmup: bool = False):
+                 threads: int = None, warmup: bool = False,
+                 headers: List[str] = None):
         self.env = env
         self._location = location
         self._clients = clients
@@ -300,6 +360,7 @@ class UrlsLoadTest(LoadTestCase):
         self._threads = threads if threads is not None else min(2, self._clients)
         self._url_file = "{gen_dir}/h2load-urls.txt".format(gen_dir=self.env.gen_dir)
         self._warmup = warmup
+        self._headers = headers if headers is not None else []
 
     @staticmethod
     def from_scenario(scenario: Dict, env: H2TestEnv) -> 'UrlsLoadTest':
@@ -309,7 +370,8 @@ class UrlsLoadTest(LoadTestCase):
             clients=scenario['clients'], requests=scenario['requests'],
             file_sizes=scenario['file_sizes'], file_count=scenario['file_count'],
             protocol=scenario['protocol'], max_parallel=scenario['max_parallel'],
-            warmup=scenario['warmup'], measure=scenario['measure']
+            warmup=scenario['warmup'], measure=scenario['measure'],
+            headers=scenario.get('headers', None)
         )
 
     def next_scenario(self, scenario: Dict) -> 'UrlsLoadTest':
@@ -319,7 +381,8 @@ class UrlsLoadTest(LoadTestCase):
             clients=scenario['clients'], requests=scenario['requests'],
             file_sizes=scenario['file_sizes'], file_count=scenario['file_count'],
             protocol=scenario['protocol'], max_parallel=scenario['max_parallel'],
-            warmup=scenario['warmup'], measure=scenario['measure']
+            warmup=scenario['warmup'], measure=scenario['measure'],
+            headers=scenario.get('headers', None)
         )
 
     def _setup(self, cls, extras: Dict = None):
@@ -357,6 +420,7 @@ class UrlsLoadTest(LoadTestCase):
                                     title=f"{self._protocol}/"
                                           f"{self._file_count / 1024}f/{self._clients}c[{mode}]")
             monitor.start()
+            syscalls = httpd_syscalls(self.env)
             args = [
                 'h2load',
                 '--clients={0}'.format(self._clients),
@@ -366,6 +430,8 @@ class UrlsLoadTest(LoadTestCase):
                 '--log-file={0}'.format(log_file),
                 f'--connect-to=localhost:{self.env.https_port}',
             ]
+            for header in self._headers:
+                args.extend(['-H', header])
             if self._protocol == 'h1' or self._protocol == 'http/1.1':
                 args.append('--h1')
             elif self._protocol == 'h2':
@@ -380,6 +446,7 @@ class UrlsLoadTest(LoadTestCase):
             summary = monitor.get_summary(duration=r.duration)
             summary.set_expected_responses(self._requests)
             summary.set_exec_result(r)
+            summary.set_syscalls(httpd_syscalls(self.env) - syscalls)
             return summary
         finally:
             if monitor is not None:
@@ -405,11 +472,61 @@ class UrlsLoadTest(LoadTestCase):
             reqs = summary.response_count / summary.duration.total_seconds()
             mean_size = statistics.mean(self._file_sizes)
             r = "{0:d}".format(round(reqs * mean_size / 1024.0))
+        elif self._measure == 'syscalls/req':
+            r = "{0:.1f}".format(summary.syscalls / max(1, summary.response_count))
+        elif self._measure == 'syscalls/s':
+            r = "{0:d}".format(round(summary.syscalls / summary.duration.total_seconds()))
         else:
             raise Exception(f"measure '{self._measure}' not defined")
         return r, summary.get_footnote()
 
 
+class CgiLoadTest(UrlsLoadTest):
+    """Requests a CGI script that either leaves the response to httpd or,
+       as a nph- script, writes its own HTTP/1.1 status line and headers
+       that mod_http2 has to parse again."""
+
+    SCRIPTS = {
+        'native': ("native.cgi", "printf 'Content-Type: text/plain\\r\\n\\r\\n'"),
+        'nph': ("nph-h1.cgi", "printf 'HTTP/1.1 200 OK\\r\\n"
+                              "Content-Type: text/plain\\r\\n\\r\\n'"),
+    }
+
+    def __init__(self, env: H2TestEnv, cgi: str, **kwargs):
+        super().__init__(env=env, **kwargs)
+        self._cgi = cgi
+
+    @staticmethod
+    def from_scenario(scenario: Dict, env: H2TestEnv) -> 'CgiLoadTest':
+        return CgiLoadTest(
+            env=env, cgi=scenario['cgi'],
+            location=scenario['location'],
+            clients=scenario['clients'], requests=scenario['requests'],
+            file_sizes=scenario['file_sizes'], file_count=scenario['file_count'],
+            protocol=scenario['protocol'], max_parallel=scenario['max_parallel'],
+            warmup=scenario['warmup'], measure=scenario['measure'],
+        )
+
+    def next_scenario(self, scenario: Dict) -> 'CgiLoadTest':
+        return CgiLoadTest.from_scenario(scenario, env=self.env)
+
+    def _setup(self, cls, extras: Dict = None):
+        LoadTestCase.server_setup(env=self.env, extras=extras)
+        cgi_dir = os.path.join(self.env.server_docs_dir, "cgi", "load")
+        os.makedirs(cgi_dir, exist_ok=True)
+        body = os.path.join(cgi_dir, "body-{0}k.txt".format(self._file_sizes[0]))
+        if not os.path.isfile(body):
+            mk_text_file(body, 8 * self._file_sizes[0])
+        fname, head = self.SCRIPTS[self._cgi]
+        fpath = os.path.join(cgi_dir, fname)
+        with open(fpath, 'w') as fd:
+            fd.write(f"#!/bin/sh\n{head}\ncat {body}\n")
+        os.chmod(fpath, 0o755)
+        with open(self._url_file, 'w') as fd:
+            fd.write(f"{self._location}{fname}\n")
+        self.start_server(env=self.env)
+
+
 class StressTest(LoadTestCase):
 
     SETUP_DONE = False
@@ -710,6 +827,110 @@ class LoadTest:
                     {"file_sizes": [10000], "requests": 5000},
                 ],
             },
+            "syscalls": {
+                "title": "1k files, 1k-100k, 10k req, read+write syscalls ({measure})",
+                "class": UrlsLoadTest,
+                "location": "/",
+                "file_count": 1024,
+                "file_sizes": [1, 2, 3, 4, 5, 10, 20, 30, 40, 50, 100],
+                "requests": 10000,
+                "warmup": True,
+                "measure": "syscalls/req",
+                "protocol": 'h2',
+                "max_parallel": 1,
+                "row0_title": "protocol  max",
+                "row_title": "{protocol}   {max_parallel:3d}",
+                "rows": [
+                    {"protocol": 'h2', "max_parallel": 1},
+                    {"protocol": 'h2', "max_parallel": 6},
+                    {"protocol": 'h2', "max_parallel": 50},
+                    {"protocol": 'h1', "max_parallel": 1},
+                ],
+                "col_title": "{clients}c",
+                "clients": 1,
+                "columns": [
+                    {"clients": 1},
+                    {"clients": 8},
+                ],
+            },
+            "setup": {
+                "title": "session setup, 1 req/conn, 1k size, *conn ({measure})",
+                "class": UrlsLoadTest,
+                "location": "/",
+                "file_count": 1,
+                "file_sizes": [1],
+                "requests": 1000,
+                "warmup": True,
+                "measure": "req/s",
+                "protocol": 'h2',
+                "max_parallel": 1,
+                "row0_title": "protocol",
+                "row_title": "{protocol}",
+                "rows": [
+                    {"protocol": 'h2'},
+                    {"protocol": 'h1'},
+                ],
+                "col_title": "{clients}c",
+                "clients": 1,
+                "columns": [
+                    {"clients": 1000, "requests": 1000},
+                    {"clients": 4000, "requests": 4000},
+                    {"clients": 16000, "requests": 16000},
+                ],
+            },
+            "headers": {
+                "title": "request header sets, 1k size, 100k req ({measure})",
+                "class": UrlsLoadTest,
+                "location": "/",
+                "file_count": 1,
+                "file_sizes": [1],
+                "requests": 100000,
+                "warmup": True,
+                "measure": "req/s",
+                "protocol": 'h2',
+                "max_parallel": 6,
+                "headers": [],
+                "row0_title": "headers",
+                "row_title": "{header_set:9s}",
+                "rows": [
+                    {"header_set": "none", "headers": []},
+                    {"header_set": "browser", "headers": BROWSER_HEADERS},
+                    {"header_set": "cookies", "headers": BROWSER_HEADERS + [
+                        f"cookie: c{i}=0123456789abcdef0123" for i in range(30)
+                    ]},
+                ],
+                "col_title": "{clients}c",
+                "clients": 1,
+                "columns": [
+                    {"clients": 1},
+                    {"clients": 8},
+                ],
+            },
+            "cgi": {
+                "title": "cgi response headers, native vs. nph, 1k size ({measure})",
+                "class": CgiLoadTest,
+                "location": "/cgi-load/",
+                "file_count": 1,
+                "file_sizes": [1],
+                "requests": 5000,
+                "warmup": True,
+                "measure": "req/s",
+                "protocol": 'h2',
+                "max_parallel": 6,
+                "cgi": "native",
+                "row0_title": "cgi",
+                "row_title": "{cgi:6s}",
+                "rows": [
+                    {"cgi": "native"},
+                    {"cgi": "nph"},
+                ],
+                "col_title": "{clients}c",
+                "clients": 1,
+                "columns": [
+                    {"clients": 1},
+                    {"clients": 8},
+                ],
+            },
             "bursty": {
                 "title": "1k files, {clients} clients, {requests} request, (req/s)",
                 "class": StressTest,
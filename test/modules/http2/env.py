@@ -96,6 +96,28 @@ class H2TestEnv(HttpdTestEnv):
     def setup_httpd(self, setup: HttpdTestSetup = None):
         super().setup_httpd(setup=H2TestSetup(env=self))
 
+    def httpd_cpu_time(self) -> float:
+        """Seconds of CPU used so far by the running httpd processes,
+           as reported by /proc/<pid>/stat on Linux, or 0."""
+        pid_file = os.path.join(self.server_dir, 'httpd.pid')
+        if not os.path.isfile(pid_file) or not os.path.isdir('/proc'):
+            return 0
+        with open(pid_file) as fd:
+            ppid = fd.read().strip()
+        ticks = 0
+        for pid in [d for d in os.listdir('/proc') if d.isdigit()]:
+            try:
+                with open(f"/proc/{pid}/stat") as fd:
+                    stat = fd.read()
+                fields = stat[stat.rindex(')') + 2:].split()
+                if pid != ppid and fields[1] != ppid:
+                    continue
+                # utime and stime
+                ticks += int(fields[11]) + int(fields[12])
+            except (OSError, ValueError):
+                pass
+        return ticks / os.sysconf('SC_CLK_TCK')
+
 
 class H2Conf(HttpdConf):
 
@@ -69,6 +69,7 @@ class TestPost:
         ("H2_PUSHED_ON", ""),
         ("H2_STREAM_ID", "1"),
         ("H2_STREAM_TAG", r'\d+-1'),
+        ("H2_TLS_RECORD_SIZE", r'\d+'),
     ])
     def test_h2_004_07(self, env, name, value):
         url = env.mkurl("https", "cgi", "/env.py")
@@ -187,6 +188,26 @@ CustomLog logs/test_004_30 issue_203
         assert log_h2['bytes_resp_B'] == chunk
         assert log_h2['bytes_tx_O'] > chunk
         
+    # uploads with static and with auto tuned receive windows
+    @pytest.mark.parametrize("max_win", [0, 65536, 8388608])
+    def test_h2_004_31(self, env, max_win):
+        H2Conf(env).add(f"H2MaxWindowSize {max_win}").add_vhost_cgi().install()
+        assert env.apache_restart() == 0
+        self.curl_upload_and_verify(env, "data-100k", ["--http2"])
+        self.curl_upload_and_verify(env, "data-1m", ["--http2"])
+
+    # bodies without content-length go to the request as is, the
+    # LimitRequestBody still applies
+    def test_h2_004_32(self, env):
+        H2Conf(env).add("LimitRequestBody 10000").add_vhost_cgi().install()
+        assert env.apache_restart() == 0
+        self.nghttp_post_and_verify(env, "data-1k", ["--no-content-length"])
+        url = env.mkurl("https", "cgi", "/echo.py")
+        fpath = os.path.join(env.gen_dir, "data-100k")
+        r = env.nghttp().upload(url, fpath, options=["--no-content-length"])
+        assert r.exit_code == 0
+        assert r.response["status"] == 413
+
     def test_h2_004_40(self, env):
         # echo content using h2test_module "echo" handler
         def post_and_verify(fname, options=None):
@@ -0,0 +1,63 @@
+import pytest
+
+from .env import H2Conf
+
+
+class TestStatus:
+
+    @pytest.fixture(autouse=True, scope='class')
+    def _class_scope(self, env):
+        conf = H2Conf(env)
+        conf.start_vhost(domains=[f"test1.{env.http_tld}"], port=env.https_port,
+                         doc_root="htdocs/test1")
+        conf.add("""
+              <Location /h2-status>
+                SetHandler h2-status
+              </Location>""")
+        conf.end_vhost()
+        conf.install()
+        assert env.apache_restart() == 0
+
+    # our own session, with the stream asking for the status, is listed
+    def test_h2_007_01(self, env):
+        url = env.mkurl("https", "test1", "/h2-status")
+        r = env.curl_get(url, 5)
+        assert r.response["status"] == 200
+        status = r.response["json"]
+        assert status["pid"] > 0
+        sessions = [s for s in status["sessions"] if len(s["streams"]) > 0]
+        assert len(sessions) >= 1
+        stream = sessions[0]["streams"][0]
+        for key in ["id", "state", "in_bytes", "out_bytes", "in_buffered",
+                    "out_buffered", "queued_us", "processing_us", "done"]:
+            assert key in stream
+        for key in ["state", "open_streams", "processing_limit", "queued",
+                    "responses"]:
+            assert key in sessions[0]
+        assert sessions[0]["responses"]["native"] >= 0
+        assert sessions[0]["responses"]["h1"] == 0
+
+    # HPACK numbers are reported, also with dynamic tables switched off
+    @pytest.mark.parametrize("table_size", ["4096", "0 0"])
+    def test_h2_007_02(self, env, table_size):
+        conf = H2Conf(env)
+        conf.add(f"H2HeaderTableSize {table_size}")
+        conf.start_vhost(domains=[f"test1.{env.http_tld}"], port=env.https_port,
+                         doc_root="htdocs/test1")
+        conf.add("""
+              <Location /h2-status>
+                SetHandler h2-status
+              </Location>""")
+        conf.end_vhost()
+        conf.install()
+        assert env.apache_restart() == 0
+        url = env.mkurl("https", "test1", "/h2-status")
+        r = env.curl_get(url, 5)
+        assert r.response["status"] == 200
+        sessions = [s for s in r.response["json"]["sessions"] if len(s["streams"]) > 0]
+        assert len(sessions) >= 1
+        hpack = sessions[0]["hpack"]
+        assert hpack["in_raw"] > 0
+        assert hpack["in_wire"] > 0
+        if table_size.startswith("0"):
+            assert hpack["in_table"] == 0
@@ -0,0 +1,93 @@
+import socket
+import struct
+import time
+
+from .env import H2Conf
+
+PREFACE = b"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+FRAME_SETTINGS = 0x4
+FRAME_PING = 0x6
+FRAME_GOAWAY = 0x7
+FLAG_ACK = 0x1
+ENHANCE_YOUR_CALM = 0xb
+
+
+def h2_frame(ftype: int, flags: int, sid: int, payload: bytes = b"") -> bytes:
+    return struct.pack(">I", len(payload))[1:] + struct.pack(">BBI", ftype, flags, sid) + payload
+
+
+class TestCtrlFrames:
+
+    # open a h2c connection with prior knowledge, send `count` PINGs and
+    # collect the frames the server answers with until it closes or goes quiet
+    def ping_flood(self, env, count: int, timeout: float = 3):
+        sock = socket.create_connection(('localhost', int(env.http_port)))
+        frames = []
+        try:
+            data = PREFACE + h2_frame(FRAME_SETTINGS, 0, 0)
+            for i in range(count):
+                data += h2_frame(FRAME_PING, 0, 0, struct.pack(">Q", i))
+            sock.sendall(data)
+            sock.settimeout(1)
+            buf = b""
+            end = time.time() + timeout
+            while time.time() < end:
+                try:
+                    chunk = sock.recv(16384)
+                except socket.timeout:
+                    break
+                if not chunk:
+                    break
+                buf += chunk
+                while len(buf) >= 9:
+                    flen = struct.unpack(">I", b"\0" + buf[0:3])[0]
+                    if len(buf) < 9 + flen:
+                        break
+                    ftype, flags = buf[3], buf[4]
+                    frames.append((ftype, flags, buf[9:9 + flen]))
+                    buf = buf[9 + flen:]
+        except ConnectionResetError:
+            pass
+        finally:
+            sock.close()
+        return frames
+
+    def goaway_error(self, frames):
+        for ftype, flags, payload in frames:
+            if ftype == FRAME_GOAWAY:
+                return struct.unpack(">I", payload[4:8])[0]
+        return None
+
+    # a few PINGs are fine with the defaults
+    def test_h2_107_01(self, env):
+        conf = H2Conf(env)
+        conf.add_vhost_cgi()
+        conf.install()
+        assert env.apache_restart() == 0
+        frames = self.ping_flood(env, 50)
+        acks = [f for f in frames if f[0] == FRAME_PING and f[1] & FLAG_ACK]
+        assert len(acks) == 50
+        assert self.goaway_error(frames) is None
+
+    # a PING flood exceeds the per client limit, the connection
+    # limit is switched off
+    def test_h2_107_02(self, env):
+        conf = H2Conf(env)
+        conf.add("H2ControlFrameRate 0 50")
+        conf.add_vhost_cgi()
+        conf.install()
+        assert env.apache_restart() == 0
+        frames = self.ping_flood(env, 500)
+        assert self.goaway_error(frames) == ENHANCE_YOUR_CALM
+        acks = [f for f in frames if f[0] == FRAME_PING and f[1] & FLAG_ACK]
+        assert len(acks) < 500
+
+    # same for the per connection limit
+    def test_h2_107_03(self, env):
+        conf = H2Conf(env)
+        conf.add("H2ControlFrameRate 50")
+        conf.add_vhost_cgi()
+        conf.install()
+        assert env.apache_restart() == 0
+        frames = self.ping_flood(env, 500)
+        assert self.goaway_error(frames) == ENHANCE_YOUR_CALM
@@ -12,6 +12,7 @@ class TestEarlyHints:
                                 port=env.https_port, doc_root="htdocs/test1"
         ).add("""
         H2EarlyHints on
+        H2EarlyHintsLearn on
         RewriteEngine on
         RewriteRule ^/006-(.*)?\\.html$ /006.html
         <Location /006-hints.html>
@@ -44,3 +45,52 @@ class TestEarlyHints:
         promises = r.results["streams"][r.response["id"]]["promises"]
         assert 1 == len(promises)
         assert "previous" not in r.response
+
+    # H2EarlyHintsLearn announces the assets clients loaded with a page
+    def test_h2_401_33(self, env):
+        url = env.mkurl("https", "hints", "/006-learn.html")
+        early = None
+        # pages are learned per child process, we may need some tries
+        for _ in range(20):
+            r = env.nghttp().assets(url)
+            assert 0 == r.exit_code
+            r = env.nghttp().get(url)
+            assert r.response["status"] == 200
+            if "previous" in r.response:
+                early = r.response["previous"]
+                break
+        assert early
+        assert 103 == int(early["header"][":status"])
+        link = early["header"]["link"]
+        assert "</006/006.css>; rel=preload; as=style; nopush" in link
+        assert "</006/006.js>; rel=preload; as=script; nopush" in link
+
+    # with push disabled by the client, the 103 comes from the main connection
+    def test_h2_401_34(self, env):
+        url = env.mkurl("https", "hints", "/006-learn-np.html")
+        early = None
+        for _ in range(20):
+            r = env.nghttp().assets(url, options=["--no-push"])
+            assert 0 == r.exit_code
+            r = env.nghttp().get(url, options=["--no-push"])
+            assert r.response["status"] == 200
+            if "previous" in r.response:
+                early = r.response["previous"]
+                break
+        assert early
+        assert 103 == int(early["header"][":status"])
+        link = early["header"]["link"]
+        assert "</006/006.css>; rel=preload; as=style; nopush" in link
+        assert "</006/006.js>; rel=preload; as=script; nopush" in link
+
+    # the 103 from the main connection carries the hints of the request's
+    # vhost and location, and the worker does not send another one
+    def test_h2_401_35(self, env):
+        url = env.mkurl("https", "hints", "/006-hints.html")
+        r = env.nghttp().get(url, options=["--no-push"])
+        assert r.response["status"] == 200
+        early = r.response["previous"]
+        assert early
+        assert 103 == int(early["header"][":status"])
+        assert "</006/006.css>; rel=preload; critical" in early["header"]["link"]
+        assert "previous" not in early
@@ -24,3 +24,32 @@ class TestH2Proxy:
         assert r.response["json"]["h2"] == "on"
         assert r.response["json"]["h2push"] == "off"
         assert r.response["json"]["host"] == f"cgi.{env.http_tld}"
+
+    # concurrent requests from one connection, the backend session is shared
+    def test_h2_600_02(self, env):
+        url = env.mkurl("https", "cgi", "/h2proxy/env.py")
+        urls = [f"{url}?name=REMOTE_PORT&wait=1&x={i}" for i in range(10)]
+        r = env.nghttp().get(urls)
+        assert r.exit_code == 0
+        streams = r.results["streams"]
+        assert len(streams) == 10
+        ports = set()
+        for sid in streams:
+            assert streams[sid]["response"]["status"] == 200
+            ports.add(streams[sid]["response"]["body"].decode().strip())
+        # the requests overlap in the backend, fewer connections
+        # than requests means that some were streams in the same one
+        assert len(ports) < len(streams), f"{ports}"
+
+    # concurrent responses larger than a stream window, the requests that
+    # share the session pass their data on themselves
+    def test_h2_600_03(self, env):
+        url = env.mkurl("https", "cgi", "/h2proxy/necho.py")
+        urls = [f"{url}?count=10000&text=0123456789&x={i}" for i in range(10)]
+        r = env.nghttp().get(urls)
+        assert r.exit_code == 0
+        streams = r.results["streams"]
+        assert len(streams) == 10
+        for sid in streams:
+            assert streams[sid]["response"]["status"] == 200
+            assert len(streams[sid]["response"]["body"]) == 10000 * 11
@@ -1,4 +1,4 @@
-from datetime import timedelta
+from datetime import datetime, timedelta
 
 import pytest
 
@@ -55,3 +55,52 @@ class TestBuffering:
         stutter = timedelta(seconds=0.4)  # need a bit more delay since we have the extra connection
         piper = CurlPiper(env=env, url=url)
         piper.stutter_check(chunks, stutter)
+
+    def test_h2_712_04(self, env):
+        # same as 712_02, but with delayed flushes on the frontend. Each
+        # chunk must still arrive within the flush delay.
+        conf = H2Conf(env)
+        conf.add("H2OutputFlushDelay 5ms")
+        conf.add_vhost_cgi(h2proxy_self=True).install()
+        assert env.apache_restart() == 0
+        url = env.mkurl("https", "cgi", "/h2proxy/h2test/echo")
+        base_chunk = "0123456789"
+        chunks = ["chunk-{0:03d}-{1}\n".format(i, base_chunk) for i in range(3)]
+        stutter = timedelta(seconds=0.4)
+        piper = CurlPiper(env=env, url=url)
+        piper.stutter_check(chunks, stutter)
+
+    def test_h2_712_05(self, env):
+        # large responses with streams held back on a full c1 socket
+        conf = H2Conf(env)
+        conf.add("H2TCPNotSentLowat 16384")
+        conf.add_vhost_cgi(h2proxy_self=True).install()
+        assert env.apache_restart() == 0
+        url = env.mkurl("https", "cgi", "/necho.py")
+        n, text = 100000, "0123456789"
+        r = env.curl_get(url, 5, options=["-F", f"count={n}", "-F", f"text={text}"])
+        assert r.response["status"] == 200
+        assert r.response["body"].decode('utf-8') == (text + "\n") * n
+
+    def test_h2_712_06(self, env):
+        # a slow reading client keeps streams held back on a full c1 socket,
+        # the session has to wait for it and not spin on the CPU.
+        if not env.httpd_cpu_time():
+            pytest.skip("no process CPU times available")
+        conf = H2Conf(env)
+        conf.add("H2TCPNotSentLowat 16384")
+        conf.add_vhost_cgi(h2proxy_self=True).install()
+        assert env.apache_restart() == 0
+        url = env.mkurl("https", "cgi", "/necho.py")
+        n, text = 50000, "0123456789"
+        cpu_start = env.httpd_cpu_time()
+        start = datetime.now()
+        r = env.curl_get(url, 5, options=[
+            "--limit-rate", "200k", "-F", f"count={n}", "-F", f"text={text}"
+        ])
+        duration = (datetime.now() - start).total_seconds()
+        cpu = env.httpd_cpu_time() - cpu_start
+        assert r.response["status"] == 200
+        assert r.response["body"].decode('utf-8') == (text + "\n") * n
+        assert duration > 1
+        assert cpu < duration / 4, f"httpd used {cpu}s CPU in {duration}s"
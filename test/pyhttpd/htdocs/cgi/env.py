@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 import cgi, os
+import time
 import cgitb; cgitb.enable()
 
 status = '200 Ok'
@@ -8,6 +9,10 @@ try:
     form = cgi.FieldStorage()
     input = form['name']
 
+    waitsec = float(form['wait'].value) if 'wait' in form else 0.0
+    if waitsec > 0:
+        time.sleep(waitsec)
+
     # Test if the file was uploaded
     if input.value is not None:
         val = os.environ[input.value] if input.value in os.environ else ""
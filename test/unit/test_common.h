@@ -41,3 +41,4 @@
  */
 
 TCase *h2_util_test_case(void);
+TCase *h2_push_test_case(void);
@@ -0,0 +1,138 @@
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <apr.h>
+#include <apr_strings.h>
+#include <apr_tables.h>
+
+#include "test_common.h"
+#include "h2.h"
+#include "h2_push.h"
+
+/*
+ * Helpers
+ */
+
+/* spread the test values over all bits, like real hashes */
+static apr_uint64_t hval(int i)
+{
+    return (apr_uint64_t)(i + 1) * APR_UINT64_C(0x9e3779b97f4a7c15);
+}
+
+/*
+ * Test Fixture -- runs once per test
+ */
+
+static apr_pool_t *g_pool;
+
+static void h2_push_setup(void)
+{
+    if (apr_pool_create(&g_pool, NULL) != APR_SUCCESS) {
+        exit(1);
+    }
+}
+
+static void h2_push_teardown(void)
+{
+    apr_pool_destroy(g_pool);
+}
+
+START_TEST(diary_h2_push_evict)
+{
+    h2_push_diary *diary = h2_push_diary_create(g_pool, 4);
+    int i;
+
+    ck_assert_ptr_nonnull(diary);
+    ck_assert_int_eq(diary->N, 4);
+    for (i = 0; i < 4; ++i) {
+        ck_assert_int_eq(h2_push_diary_add(diary, hval(i)), 1);
+    }
+    /* full, the oldest ones go first */
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(4)), 1);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(5)), 1);
+    ck_assert_int_eq(diary->nelts, 4);
+    /* 0 and 1 are gone, entering 0 again forgets 2 */
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(0)), 1);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(3)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(4)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(5)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(0)), 0);
+    ck_assert_int_eq(diary->nelts, 4);
+    /* 1 and 2 went before the others */
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(2)), 1);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(1)), 1);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(5)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(0)), 0);
+}
+END_TEST
+
+START_TEST(diary_h2_push_refresh)
+{
+    h2_push_diary *diary = h2_push_diary_create(g_pool, 4);
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+        ck_assert_int_eq(h2_push_diary_add(diary, hval(i)), 1);
+    }
+    /* a hit makes 0 the most recently used, 1 is the oldest now */
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(0)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(4)), 1);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(0)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(1)), 1);
+    /* that pushed out 2, the next oldest */
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(3)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(2)), 1);
+    ck_assert_int_eq(diary->nelts, 4);
+}
+END_TEST
+
+START_TEST(diary_h2_push_grow)
+{
+    h2_push_diary *diary = h2_push_diary_create(g_pool, 100);
+    int i, n = 100;
+
+    ck_assert_int_eq(diary->N, 128);
+    for (i = 0; i < n; ++i) {
+        ck_assert_int_eq(h2_push_diary_add(diary, hval(i)), 1);
+    }
+    /* slots grew from 16 by doubling, all entries are still found */
+    ck_assert_int_eq(diary->nelts, n);
+    ck_assert_int_eq(diary->nalloc, 128);
+    for (i = 0; i < n; ++i) {
+        ck_assert_int_eq(h2_push_diary_add(diary, hval(i)), 0);
+    }
+    ck_assert_int_eq(diary->nelts, n);
+    /* and the LRU order survived: fill up, then 0 is the oldest */
+    for (i = n; i < 128; ++i) {
+        ck_assert_int_eq(h2_push_diary_add(diary, hval(i)), 1);
+    }
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(1000)), 1);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(1)), 0);
+    ck_assert_int_eq(h2_push_diary_add(diary, hval(0)), 1);
+}
+END_TEST
+
+TCase *h2_push_test_case(void)
+{
+    TCase *testcase = tcase_create("h2_push");
+
+    tcase_add_checked_fixture(testcase, h2_push_setup, h2_push_teardown);
+
+    tcase_add_test(testcase, diary_h2_push_evict);
+    tcase_add_test(testcase, diary_h2_push_refresh);
+    tcase_add_test(testcase, diary_h2_push_grow);
+
+    return testcase;
+}
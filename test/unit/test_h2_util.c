@@ -19,6 +19,7 @@
 #include <apr_buckets.h>
 
 #include "test_common.h"
+#include "h2.h"
 #include "h2_util.h"
 
 /*
@@ -101,6 +102,199 @@ START_TEST(base64_h2_util_largetrip)
 }
 END_TEST
 
+START_TEST(tbucket_h2_util_rate)
+{
+    h2_tbucket tb;
+    apr_time_t now = apr_time_from_sec(1000);
+    int i;
+
+    h2_tbucket_init(&tb, 5, now);
+    for (i = 0; i < 5; ++i) {
+        ck_assert(h2_tbucket_take(&tb, 10, 5, now));
+    }
+    ck_assert(!h2_tbucket_take(&tb, 10, 5, now));
+    /* 10 per second, one token after 100ms */
+    now += apr_time_from_msec(50);
+    ck_assert(!h2_tbucket_take(&tb, 10, 5, now));
+    now += apr_time_from_msec(50);
+    ck_assert(h2_tbucket_take(&tb, 10, 5, now));
+    ck_assert(!h2_tbucket_take(&tb, 10, 5, now));
+    /* never more than burst after a long pause */
+    now += apr_time_from_sec(3600 * 24);
+    for (i = 0; i < 5; ++i) {
+        ck_assert(h2_tbucket_take(&tb, 10, 5, now));
+    }
+    ck_assert(!h2_tbucket_take(&tb, 10, 5, now));
+}
+END_TEST
+
+START_TEST(mem_size_h2_util_bucket)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(g_pool);
+    apr_bucket_brigade *bb = apr_brigade_create(g_pool, ba);
+    apr_bucket *b;
+    apr_off_t total = 0;
+
+    b = apr_bucket_heap_create("0123456789", 10, NULL, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, b);
+    ck_assert_int_eq(h2_bucket_mem_size(b), sizeof(*b) + 10);
+    total += h2_bucket_mem_size(b);
+    /* memory not owned by the bucket is not counted */
+    b = apr_bucket_immortal_create("abc", 3, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, b);
+    ck_assert_int_eq(h2_bucket_mem_size(b), sizeof(*b));
+    total += h2_bucket_mem_size(b);
+    b = apr_bucket_eos_create(ba);
+    APR_BRIGADE_INSERT_TAIL(bb, b);
+    ck_assert_int_eq(h2_bucket_mem_size(b), sizeof(*b));
+    total += h2_bucket_mem_size(b);
+
+    ck_assert_int_eq(h2_brigade_mem_size(bb), total);
+    apr_brigade_destroy(bb);
+}
+END_TEST
+
+START_TEST(known_h2_util_header)
+{
+    static const char *names[] = {
+        "accept", "accept-charset", "accept-encoding", "accept-language",
+        "accept-ranges", "access-control-allow-credentials",
+        "access-control-allow-headers", "access-control-allow-methods",
+        "access-control-allow-origin", "access-control-expose-headers",
+        "access-control-max-age", "access-control-request-headers",
+        "access-control-request-method", "age", "allow", "alt-svc",
+        "authorization", "cache-control", "connection", "content-disposition",
+        "content-encoding", "content-language", "content-length",
+        "content-location", "content-range", "content-security-policy",
+        "content-type", "cookie", "cross-origin-opener-policy",
+        "cross-origin-resource-policy", "date", "dnt", "early-data", "etag",
+        "expect", "expires", "forwarded", "from", "host", "http2-settings",
+        "if-match", "if-modified-since", "if-none-match", "if-range",
+        "if-unmodified-since", "keep-alive", "last-modified", "link",
+        "location", "max-forwards", "origin", "permissions-policy", "pragma",
+        "priority", "proxy-authenticate", "proxy-authorization",
+        "proxy-connection", "purpose", "push-policy", "range", "referer",
+        "referrer-policy", "retry-after", "save-data", "sec-ch-ua",
+        "sec-ch-ua-mobile", "sec-ch-ua-platform", "sec-fetch-dest",
+        "sec-fetch-mode", "sec-fetch-site", "sec-fetch-user", "sec-purpose",
+        "server", "server-timing", "set-cookie", "strict-transport-security",
+        "te", "timing-allow-origin", "trailer", "transfer-encoding",
+        "upgrade", "upgrade-insecure-requests", "user-agent", "vary", "via",
+        "warning", "www-authenticate", "x-content-type-options",
+        "x-forwarded-for", "x-forwarded-host", "x-forwarded-proto",
+        "x-frame-options", "x-requested-with", "x-xss-protection",
+    };
+    char buffer[64];
+    size_t i, len;
+
+    for (i = 0; i < sizeof(names)/sizeof(names[0]); ++i) {
+        len = strlen(names[i]);
+        memcpy(buffer, names[i], len + 1);
+        h2_util_camel_case_header(buffer, len);
+        ck_assert_str_eq(h2_util_known_header(names[i], len), buffer);
+        ck_assert_str_eq(h2_util_known_header(buffer, len), buffer);
+    }
+    ck_assert(h2_util_known_header("x-foo", 5) == NULL);
+    ck_assert(h2_util_known_header("accept", 5) == NULL);
+    ck_assert(h2_util_known_header("", 0) == NULL);
+}
+END_TEST
+
+START_TEST(cookies_h2_util_join)
+{
+    apr_table_t *headers = apr_table_make(g_pool, 5);
+    const char *ua = "test";
+    int added;
+
+    ck_assert_int_eq(h2_req_add_header(headers, g_pool, "cookie", 6,
+                                       "a=1", 3, 0, 0, &added), APR_SUCCESS);
+    ck_assert_int_eq(added, 1);
+    ck_assert_int_eq(h2_req_add_header(headers, g_pool, "user-agent", 10,
+                                       ua, 4, 1, 0, &added), APR_SUCCESS);
+    ck_assert_int_eq(h2_req_add_header(headers, g_pool, "cookie", 6,
+                                       "b=2", 3, 0, 0, &added), APR_SUCCESS);
+    ck_assert_int_eq(added, 0);
+    ck_assert_int_eq(h2_req_add_header(headers, g_pool, "cookie", 6,
+                                       "c=3", 3, 0, 0, &added), APR_SUCCESS);
+    h2_req_join_cookies(headers, g_pool);
+    ck_assert_str_eq(apr_table_get(headers, "Cookie"), "a=1; b=2; c=3");
+    /* a kept value is not copied */
+    ck_assert(apr_table_get(headers, "User-Agent") == ua);
+    ck_assert_int_eq(apr_table_elts(headers)->nelts, 2);
+}
+END_TEST
+
+START_TEST(ngheader_h2_util_make)
+{
+    h2_headers headers;
+    h2_ngheader *ngh;
+
+    memset(&headers, 0, sizeof(headers));
+    headers.status = 200;
+    headers.headers = apr_table_make(g_pool, 5);
+    headers.notes = apr_table_make(g_pool, 1);
+    apr_table_setn(headers.headers, "Content-Type", "text/plain");
+    apr_table_setn(headers.headers, "Connection", "close");
+    apr_table_setn(headers.headers, "X-Some-Thing", "value");
+
+    ck_assert_int_eq(h2_res_make_ngheader(&ngh, &headers, NULL), APR_SUCCESS);
+    /* ":status" first, "connection" is dropped, names are lower case */
+    ck_assert_int_eq(ngh->nvlen, 3);
+    ck_assert_str_eq((const char *)ngh->nv[0].name, ":status");
+    ck_assert_str_eq((const char *)ngh->nv[0].value, "200");
+    ck_assert_str_eq((const char *)ngh->nv[1].name, "content-type");
+    ck_assert_int_eq(ngh->nv[2].namelen, 12);
+    ck_assert_str_eq((const char *)ngh->nv[2].name, "x-some-thing");
+    ck_assert_str_eq(h2_ngheader_get(ngh, "x-some-thing"), "value");
+    ck_assert(h2_ngheader_get(ngh, "connection") == NULL);
+
+    ck_assert_int_eq(h2_ngheader_set_static(ngh, "push-policy", "head"), APR_SUCCESS);
+    ck_assert_int_eq(h2_ngheader_set_static(ngh, "push-policy", "none"), APR_SUCCESS);
+    ck_assert_int_eq(ngh->nvlen, 4);
+    ck_assert_str_eq(h2_ngheader_get(ngh, "push-policy"), "none");
+    h2_ngheader_unref(ngh);
+
+    apr_table_setn(headers.headers, "Bad Name", "value");
+    ck_assert_int_eq(h2_res_make_ngheader(&ngh, &headers, NULL), APR_EINVAL);
+}
+END_TEST
+
+START_TEST(ngheader_h2_util_cache)
+{
+    h2_ngheader_cache *cache;
+    h2_headers headers;
+    h2_ngheader *ngh1, *ngh2;
+
+    memset(&headers, 0, sizeof(headers));
+    headers.status = 200;
+    headers.headers = apr_table_make(g_pool, 5);
+    headers.notes = apr_table_make(g_pool, 1);
+    apr_table_setn(headers.headers, "Content-Type", "text/css");
+    apr_table_setn(headers.headers, "Content-Length", "1234");
+    apr_table_setn(headers.headers, "X-Served-By", "here");
+
+    ck_assert_int_eq(h2_ngheader_cache_create(&cache, g_pool), APR_SUCCESS);
+    ck_assert_int_eq(h2_res_make_ngheader(&ngh1, &headers, cache), APR_SUCCESS);
+    apr_table_setn(headers.headers, "Content-Length", "56");
+    ck_assert_int_eq(h2_res_make_ngheader(&ngh2, &headers, cache), APR_SUCCESS);
+
+    /* same names, the same values are shared, the others not */
+    ck_assert_int_eq(ngh2->nvlen, 4);
+    ck_assert(ngh1->nv[1].value == ngh2->nv[1].value);
+    ck_assert(ngh1->nv[3].name == ngh2->nv[3].name);
+    ck_assert_str_eq((const char *)ngh2->nv[3].name, "x-served-by");
+    ck_assert_str_eq(h2_ngheader_get(ngh1, "content-length"), "1234");
+    ck_assert_str_eq(h2_ngheader_get(ngh2, "content-length"), "56");
+    h2_ngheader_unref(ngh1);
+    ck_assert_str_eq(h2_ngheader_get(ngh2, "x-served-by"), "here");
+
+    /* a value differing from the cached set is still checked */
+    apr_table_setn(headers.headers, "X-Served-By", "t\rhere");
+    ck_assert_int_eq(h2_res_make_ngheader(&ngh1, &headers, cache), APR_EINVAL);
+    h2_ngheader_unref(ngh2);
+}
+END_TEST
+
 TCase *h2_util_test_case(void)
 {
     TCase *testcase = tcase_create("h2_util");
@@ -109,6 +303,12 @@ TCase *h2_util_test_case(void)
 
     tcase_add_test(testcase, base64_h2_util_roundtrip);
     tcase_add_test(testcase, base64_h2_util_largetrip);
+    tcase_add_test(testcase, tbucket_h2_util_rate);
+    tcase_add_test(testcase, mem_size_h2_util_bucket);
+    tcase_add_test(testcase, known_h2_util_header);
+    tcase_add_test(testcase, cookies_h2_util_join);
+    tcase_add_test(testcase, ngheader_h2_util_make);
+    tcase_add_test(testcase, ngheader_h2_util_cache);
 
     return testcase;
 }